@@ -10,9 +10,16 @@
   */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batapp_daemon.h"
 #include "batapp_logger.h"
 #include "batapp_pktparser.h"
 #include "batapp_pkttypes.h"
+#include "batapp_rollup.h"
+#include "batapp_rules.h"
+#include "batapp_shmring.h"
+#include "batapp_trace.h"
 
 
   /**
@@ -21,18 +28,160 @@
    * @param argv
    * @return int
    * @brief The main entry point function
-   * @details The main function must be executed with CodingTest.bin as first parameter.
+   * @details The main function must be executed with CodingTest.bin as the data file parameter.
+   * Usage:
+   *   batapp [--trace <trace file>] [--shm <name>] [--dedup <n>] [--reorder <ms> [--reorder-depth <n>]]
+   *          [--rules <rule file> [--alerts <alert file>]] [--rollup <rollup file>] <data file>
+   *   batapp [--trace <trace file>] [--shm <name>] [--dedup <n>] [--reorder <ms> [--reorder-depth <n>]]
+   *          [--rules <rule file> [--alerts <alert file>]] --daemon <socket> [--outdir <dir>] [--threads <n>]
+   *   batapp --shm-read <name>
+   *   batapp --tracedump <trace file> <json file>
+   *   batapp --rollup-query <rollup file> <from ms> <to ms> <resolution ms>
    */
 int main(int argc, char** argv)
 {
+	const char* datafilepath = NULL;
+	const char* tracepath = NULL;
+	const char* rollpath = NULL;
+	const char* sockpath = NULL;
+	const char* outdir = NULL;
+	const char* shmname = NULL;
+	const char* rulepath = NULL;
+	const char* alertpath = NULL;
+	int nthreads = BATAPP_DAEMON_THREADS;
+	uint32_t window = 0;
+	uint32_t depth = 0;
+	uint32_t dedup = 0;
+	bool retval;
+	int argi;
+
+	/* parse the command line options */
+	for (argi = 1; argi < argc; argi++) {
+		if ((strcmp(argv[argi], "--trace") == 0) && (argi + 1 < argc)) {
+			tracepath = argv[++argi];
+		}
+		else if ((strcmp(argv[argi], "--tracedump") == 0) && (argi + 2 < argc)) {
+			/* convert a trace to chrome/perfetto json and exit */
+			return batapp_trace_dump(argv[argi + 1], argv[argi + 2]) ? 0 : -1;
+		}
+		else if ((strcmp(argv[argi], "--rollup") == 0) && (argi + 1 < argc)) {
+			rollpath = argv[++argi];
+		}
+		else if ((strcmp(argv[argi], "--rollup-query") == 0) && (argi + 4 < argc)) {
+			/* print the rollup records for a time range and exit */
+			return batapp_rollup_query(argv[argi + 1], strtoul(argv[argi + 2], NULL, 0),
+				strtoul(argv[argi + 3], NULL, 0), strtoul(argv[argi + 4], NULL, 0)) ? 0 : -1;
+		}
+		else if ((strcmp(argv[argi], "--daemon") == 0) && (argi + 1 < argc)) {
+			sockpath = argv[++argi];
+		}
+		else if ((strcmp(argv[argi], "--outdir") == 0) && (argi + 1 < argc)) {
+			outdir = argv[++argi];
+		}
+		else if ((strcmp(argv[argi], "--threads") == 0) && (argi + 1 < argc)) {
+			char* end;
+			long val = strtol(argv[++argi], &end, 10);
+
+			/* a positive thread count, up to the cap */
+			if ((end == argv[argi]) || (*end != '\0') || (val <= 0) || (val > BATAPP_DAEMON_MAXTHREADS)) {
+				batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTMAIN_HDR, "Invalid option %s %s", argv[argi - 1], argv[argi]);
+				return -1;
+			}
+			nthreads = (int)val;
+		}
+		else if ((strcmp(argv[argi], "--shm") == 0) && (argi + 1 < argc)) {
+			shmname = argv[++argi];
+		}
+		else if ((strcmp(argv[argi], "--shm-read") == 0) && (argi + 1 < argc)) {
+			/* print the events of the shared memory ring until it is closed */
+			return batapp_shmreader_run(argv[argi + 1]) ? 0 : -1;
+		}
+		else if ((strcmp(argv[argi], "--reorder") == 0) && (argi + 1 < argc)) {
+			window = strtoul(argv[++argi], NULL, 0);
+		}
+		else if ((strcmp(argv[argi], "--reorder-depth") == 0) && (argi + 1 < argc)) {
+			depth = strtoul(argv[++argi], NULL, 0);
+		}
+		else if ((strcmp(argv[argi], "--dedup") == 0) && (argi + 1 < argc)) {
+			dedup = strtoul(argv[++argi], NULL, 0);
+		}
+		else if ((strcmp(argv[argi], "--rules") == 0) && (argi + 1 < argc)) {
+			rulepath = argv[++argi];
+		}
+		else if ((strcmp(argv[argi], "--alerts") == 0) && (argi + 1 < argc)) {
+			alertpath = argv[++argi];
+		}
+		else if ((datafilepath == NULL) && (argv[argi][0] != '-')) {
+			datafilepath = argv[argi];
+		}
+		else {
+			batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTMAIN_HDR, "Invalid option %s", argv[argi]);
+			return -1;
+		}
+	}
+
+	/* the daemon serves packet streams from its connections instead of a data file */
+	if ((sockpath != NULL) && ((datafilepath != NULL) || (rollpath != NULL))) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTMAIN_HDR, "Daemon mode takes no data file or rollup");
+		return -1;
+	}
+
+	/* alerts are only written by the rules */
+	if ((alertpath != NULL) && (rulepath == NULL)) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTMAIN_HDR, "Alert file takes a rule file");
+		return -1;
+	}
+
 	/* ensure data file was provided */
-	if (argc < 2) {
+	if ((datafilepath == NULL) && (sockpath == NULL)) {
 		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTMAIN_HDR, "Invalid or no file provided");
 		return -1;
 	}
 
+	/* start tracing the main thread if requested */
+	if (tracepath != NULL) {
+		if (!batapp_trace_open(tracepath) || !batapp_trace_thread_start(0))
+			return -1;
+	}
+
+	retval = false;
+
+	/* build the rollup in the same pass if requested */
+	if ((rollpath != NULL) && !batapp_rollup_open(rollpath))
+		goto exit_main;
+
+	/* publish binary events to the shared memory ring if requested */
+	if ((shmname != NULL) && !batapp_shmring_open(shmname))
+		goto exit_main;
+
+	/* evaluate the alert rules on the event stream if requested */
+	if ((rulepath != NULL) && !batapp_rules_load(rulepath, alertpath))
+		goto exit_main;
+
+	/* drop packets repeating one of the last n packets */
+	batapp_pktparser_setdedup(dedup);
+
+	/* reorder packets within the window before the state machines */
+	batapp_pktparser_setreorder(window, depth);
+
 	/* initiate the packet processing engine */
-	if (!batapp_pktparser_run(argv[1]))
+	if (sockpath != NULL)
+		retval = batapp_daemon_run(sockpath, outdir, nthreads);
+	else
+		retval = batapp_pktparser_run(datafilepath);
+
+exit_main:
+	/* the outputs opened so far are closed on failure too */
+	if (!batapp_rollup_close())
+		retval = false;
+
+	batapp_shmring_close();
+
+	batapp_rules_unload();
+
+	batapp_trace_thread_stop();
+
+	if (!retval)
 		return -1;
 
 	return 0;
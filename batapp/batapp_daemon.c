@@ -0,0 +1,495 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_daemon.c
+  * @brief Battery Packet Ingestion Daemon
+  * @author Subhasish Ghosh
+  */
+
+/* accept4 is a GNU extension, this must come before any include */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include "batapp_daemon.h"
+#include "batapp_logger.h"
+#include "batapp_pkttypes.h"
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "batapp_pktparser.h"
+#include "batapp_trace.h"
+
+/* The maximum number of epoll events handled per wakeup */
+#define BATAPP_DAEMON_EVENTS	64
+/* The read buffer size per worker */
+#define BATAPP_DAEMON_READLEN	65536
+
+/* This struct stores the state of one producer connection */
+typedef struct batapp_daemon_conn {
+	struct batapp_daemon_conn* prev; /* worker connection list */
+	struct batapp_daemon_conn* next;
+	int fd;
+	uint32_t id;
+	FILE* out; /* stdout or the per connection log file */
+	batapp_pktparser_t parser; /* per connection packet handler state */
+	size_t have; /* bytes of the partial packet received so far */
+	size_t need; /* bytes of the partial packet including the packet type */
+	unsigned char frame[1 + BATAPP_PKTPARSER_MAXLEN]; /* partial packet */
+} batapp_daemon_conn_t;
+
+/* This struct stores the state of one epoll worker thread */
+typedef struct {
+	pthread_t thread;
+	int epfd;
+	uint16_t tid;
+	batapp_daemon_conn_t* conns; /* connections owned by this worker */
+	unsigned char readbuff[BATAPP_DAEMON_READLEN];
+} batapp_daemon_worker_t;
+
+/* tags to tell the listen socket and the stop event apart from connections */
+static int batapp_daemon_listentag;
+static int batapp_daemon_stoptag;
+
+static int batapp_daemon_listenfd = -1;
+static int batapp_daemon_stopfd = -1;
+static const char* batapp_daemon_outdir = NULL;
+static uint32_t batapp_daemon_connid = 0;
+
+/**
+  * This function wakes up all workers to stop, it is async signal safe
+  * @param signum the signal received
+  * @return void
+  */
+static void batapp_daemon_signal(int signum) {
+	uint64_t one = 1;
+	ssize_t ret;
+
+	(void)signum;
+	ret = write(batapp_daemon_stopfd, &one, sizeof(one));
+	(void)ret;
+}
+
+/**
+  * This function accepts a new connection and adds it to the worker
+  * @param worker the worker accepting the connection
+  * @param fd the accepted socket
+  * @return bool returns success/failure for the function
+  */
+static bool batapp_daemon_conn_open(batapp_daemon_worker_t* worker, int fd) {
+	batapp_daemon_conn_t* conn;
+	struct epoll_event ev;
+	char path[4096];
+
+	if ((conn = calloc(1, sizeof(batapp_daemon_conn_t))) == NULL) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTDAEMON_HDR, "Failed to allocate connection");
+		return false;
+	}
+
+	conn->fd = fd;
+	/* connection ids start at 1, stream 0 stands for a data file */
+	conn->id = __atomic_add_fetch(&batapp_daemon_connid, 1, __ATOMIC_RELAXED);
+	conn->out = stdout;
+
+	/* open the per connection log file if requested */
+	if (batapp_daemon_outdir != NULL) {
+		snprintf(path, sizeof(path), "%s/conn-%u.log", batapp_daemon_outdir, conn->id);
+		if ((conn->out = fopen(path, "w")) == NULL) {
+			batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTDAEMON_HDR, "Failed to open %s", path);
+			free(conn);
+			return false;
+		}
+	}
+
+	if (!batapp_pktparser_open(&conn->parser, conn->out)) {
+		goto exit_conn;
+	}
+	conn->parser.id = conn->id;
+
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.ptr = conn;
+	if (epoll_ctl(worker->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTDAEMON_HDR, "Failed to add connection");
+		batapp_pktparser_close(&conn->parser);
+		goto exit_conn;
+	}
+
+	/* link the connection into the worker list */
+	conn->next = worker->conns;
+	if (worker->conns != NULL) {
+		worker->conns->prev = conn;
+	}
+	worker->conns = conn;
+
+	batapp_log(BATAPP_LOGGER_LEVEL_DBG, BATAPP_PKTDAEMON_HDR, "connection %u opened", conn->id);
+	return true;
+
+exit_conn:
+	if (conn->out != stdout) {
+		fclose(conn->out);
+	}
+	free(conn);
+	return false;
+}
+
+/**
+  * This function closes a connection and frees its handler state
+  * @param worker the worker owning the connection
+  * @param conn the connection to close
+  * @return void
+  */
+static void batapp_daemon_conn_close(batapp_daemon_worker_t* worker, batapp_daemon_conn_t* conn) {
+	/* release the packets still held for reordering */
+	batapp_pktparser_flush(&conn->parser);
+
+	/* a partial packet at close is a truncated stream */
+	if (conn->have > 0) {
+		batapp_flog(conn->out, BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTPARSER_HDR, "Truncated packet");
+	}
+
+	/* unlink the connection from the worker list */
+	if (conn->prev != NULL) {
+		conn->prev->next = conn->next;
+	}
+	else {
+		worker->conns = conn->next;
+	}
+	if (conn->next != NULL) {
+		conn->next->prev = conn->prev;
+	}
+
+	batapp_log(BATAPP_LOGGER_LEVEL_DBG, BATAPP_PKTDAEMON_HDR, "connection %u closed", conn->id);
+
+	/* closing the socket also removes it from the epoll set */
+	close(conn->fd);
+	batapp_pktparser_close(&conn->parser);
+	if (conn->out != stdout) {
+		fclose(conn->out);
+	}
+	else {
+		fflush(conn->out);
+	}
+	free(conn);
+}
+
+/**
+  * This function frames the received bytes into packets and feeds them
+  * @param conn the connection the bytes were received on
+  * @param data received bytes
+  * @param len number of received bytes
+  * @return bool returns false if the stream is corrupt
+  */
+static bool batapp_daemon_conn_frame(batapp_daemon_conn_t* conn, const unsigned char* data, size_t len) {
+	while (len > 0) {
+		size_t chunk;
+
+		/* start of a new packet */
+		if (conn->have == 0) {
+			size_t pktlen = batapp_pktparser_pktlen(data[0]);
+
+			if (pktlen == 0) {
+				batapp_flog(conn->out, BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTPARSER_HDR, "Invalid packet type");
+				return false;
+			}
+			conn->need = 1 + pktlen;
+
+			/* whole packet received, feed it without copying */
+			if (len >= conn->need) {
+				batapp_pktparser_feed(&conn->parser, data[0], data + 1);
+				data += conn->need;
+				len -= conn->need;
+				continue;
+			}
+		}
+
+		/* accumulate the partial packet */
+		chunk = conn->need - conn->have;
+		if (chunk > len) {
+			chunk = len;
+		}
+		memcpy(conn->frame + conn->have, data, chunk);
+		conn->have += chunk;
+		data += chunk;
+		len -= chunk;
+
+		if (conn->have == conn->need) {
+			batapp_pktparser_feed(&conn->parser, conn->frame[0], conn->frame + 1);
+			conn->have = 0;
+		}
+	}
+
+	return true;
+}
+
+/**
+  * This function reads and processes the pending bytes of a connection
+  * @param worker the worker owning the connection
+  * @param conn the connection to read
+  * @return bool returns false if the connection is to be closed
+  */
+static bool batapp_daemon_conn_read(batapp_daemon_worker_t* worker, batapp_daemon_conn_t* conn) {
+	ssize_t len = read(conn->fd, worker->readbuff, sizeof(worker->readbuff));
+
+	if (len < 0) {
+		return (errno == EAGAIN) || (errno == EINTR);
+	}
+
+	/* end of stream */
+	if (len == 0) {
+		return false;
+	}
+
+	BATAPP_TRACE_BEGIN(BATAPP_TRACE_DAEMON_BATCH, len);
+	if (!batapp_daemon_conn_frame(conn, worker->readbuff, (size_t)len)) {
+		BATAPP_TRACE_END(BATAPP_TRACE_DAEMON_BATCH);
+		return false;
+	}
+	/* one flush per received batch keeps the event latency low */
+	fflush(conn->out);
+	BATAPP_TRACE_END(BATAPP_TRACE_DAEMON_BATCH);
+
+	return true;
+}
+
+/**
+  * This function accepts all pending connections
+  * @param worker the worker accepting the connections
+  * @return void
+  */
+static void batapp_daemon_accept(batapp_daemon_worker_t* worker) {
+	int fd;
+
+	/* the listen socket is shared, another worker may have taken the connection */
+	while ((fd = accept4(batapp_daemon_listenfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		if (!batapp_daemon_conn_open(worker, fd)) {
+			close(fd);
+		}
+	}
+}
+
+/**
+  * This function is the epoll loop of one worker thread
+  * @param arg the worker
+  * @return NULL
+  */
+static void* batapp_daemon_worker(void* arg) {
+	batapp_daemon_worker_t* worker = arg;
+	struct epoll_event events[BATAPP_DAEMON_EVENTS];
+	bool running = true;
+
+	batapp_trace_thread_start(worker->tid);
+
+	while (running) {
+		int nev = epoll_wait(worker->epfd, events, BATAPP_DAEMON_EVENTS, -1);
+		int evidx;
+
+		if (nev < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTDAEMON_HDR, "epoll_wait failed");
+			break;
+		}
+
+		for (evidx = 0; evidx < nev; evidx++) {
+			void* ptr = events[evidx].data.ptr;
+
+			if (ptr == &batapp_daemon_stoptag) {
+				running = false;
+			}
+			else if (ptr == &batapp_daemon_listentag) {
+				batapp_daemon_accept(worker);
+			}
+			else {
+				batapp_daemon_conn_t* conn = ptr;
+
+				/* a hang up is seen as end of stream once all pending data is read */
+				if ((events[evidx].events & EPOLLERR) || !batapp_daemon_conn_read(worker, conn)) {
+					batapp_daemon_conn_close(worker, conn);
+				}
+			}
+		}
+	}
+
+	/* close all connections owned by this worker */
+	while (worker->conns != NULL) {
+		batapp_daemon_conn_close(worker, worker->conns);
+	}
+
+	batapp_trace_thread_stop();
+	return NULL;
+}
+
+/**
+  * This function creates the epoll set of a worker
+  * @param worker the worker to init
+  * @return bool returns success/failure for the function
+  */
+static bool batapp_daemon_worker_init(batapp_daemon_worker_t* worker) {
+	struct epoll_event ev;
+
+	if ((worker->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		return false;
+	}
+
+	/* all workers share the listen socket, only one is woken per connection */
+	ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+	ev.data.ptr = &batapp_daemon_listentag;
+	if (epoll_ctl(worker->epfd, EPOLL_CTL_ADD, batapp_daemon_listenfd, &ev) < 0) {
+		return false;
+	}
+
+	/* the stop event is level triggered and never read, so it wakes all workers */
+	ev.events = EPOLLIN;
+	ev.data.ptr = &batapp_daemon_stoptag;
+	if (epoll_ctl(worker->epfd, EPOLL_CTL_ADD, batapp_daemon_stopfd, &ev) < 0) {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+  * This function creates the listening unix domain socket
+  * @param sockpath path of the unix domain socket to listen on
+  * @return int the socket, -1 on failure
+  */
+static int batapp_daemon_listen(const char* sockpath) {
+	struct sockaddr_un addr;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(sockpath) >= sizeof(addr.sun_path)) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTDAEMON_HDR, "Socket path too long");
+		return -1;
+	}
+	strcpy(addr.sun_path, sockpath);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTDAEMON_HDR, "Failed to create socket");
+		return -1;
+	}
+
+	/* remove a stale socket from a previous run */
+	unlink(sockpath);
+	if ((bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) || (listen(fd, SOMAXCONN) < 0)) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTDAEMON_HDR, "Failed to listen on %s", sockpath);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+  * This function runs the ingestion daemon until SIGINT or SIGTERM
+  * @param sockpath path of the unix domain socket to listen on
+  * @param outdir directory for a log file per connection, NULL to log on stdout
+  * @param nthreads number of epoll worker threads
+  * @return bool returns success/failure for the function
+  */
+bool batapp_daemon_run(const char* sockpath, const char* outdir, int nthreads) {
+	batapp_daemon_worker_t* workers;
+	struct sigaction sa;
+	bool retval = false;
+	int started = 0;
+	int widx;
+
+	if (nthreads <= 0) {
+		nthreads = BATAPP_DAEMON_THREADS;
+	}
+	batapp_daemon_outdir = outdir;
+
+	if ((workers = calloc(nthreads, sizeof(batapp_daemon_worker_t))) == NULL) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTDAEMON_HDR, "Failed to allocate workers");
+		return retval;
+	}
+
+	if ((batapp_daemon_stopfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTDAEMON_HDR, "Failed to create stop event");
+		goto exit_daemon;
+	}
+
+	if ((batapp_daemon_listenfd = batapp_daemon_listen(sockpath)) < 0) {
+		goto exit_daemon;
+	}
+
+	/* stop on SIGINT/SIGTERM, a producer hanging up must not kill the daemon */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = batapp_daemon_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	retval = true;
+	for (widx = 0; widx < nthreads; widx++) {
+		workers[widx].epfd = -1;
+		workers[widx].tid = (uint16_t)(widx + 1);
+
+		if (!batapp_daemon_worker_init(&workers[widx]) ||
+			(pthread_create(&workers[widx].thread, NULL, batapp_daemon_worker, &workers[widx]) != 0)) {
+			batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTDAEMON_HDR, "Failed to start worker %d", widx);
+			if (workers[widx].epfd >= 0) {
+				close(workers[widx].epfd);
+			}
+			/* stop the workers already started */
+			batapp_daemon_signal(0);
+			retval = false;
+			break;
+		}
+		started++;
+	}
+
+	for (widx = 0; widx < started; widx++) {
+		pthread_join(workers[widx].thread, NULL);
+		close(workers[widx].epfd);
+	}
+
+	close(batapp_daemon_listenfd);
+	batapp_daemon_listenfd = -1;
+	unlink(sockpath);
+
+exit_daemon:
+	if (batapp_daemon_stopfd >= 0) {
+		close(batapp_daemon_stopfd);
+		batapp_daemon_stopfd = -1;
+	}
+	free(workers);
+	return retval;
+}
+
+#else
+
+/**
+  * This function runs the ingestion daemon until SIGINT or SIGTERM
+  * @param sockpath path of the unix domain socket to listen on
+  * @param outdir directory for a log file per connection, NULL to log on stdout
+  * @param nthreads number of epoll worker threads
+  * @return bool returns success/failure for the function
+  */
+bool batapp_daemon_run(const char* sockpath, const char* outdir, int nthreads) {
+	(void)sockpath;
+	(void)outdir;
+	(void)nthreads;
+
+	/* the daemon is built upon epoll and unix domain sockets */
+	batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTDAEMON_HDR, "Daemon mode is only supported on linux");
+	return false;
+}
+
+#endif
\ No newline at end of file
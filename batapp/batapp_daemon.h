@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_daemon.h
+  * @brief Battery Packet Ingestion Daemon Interface
+  * @author Subhasish Ghosh
+  *
+  * The daemon accepts packet producers on a unix domain socket. Each
+  * connection is framed incrementally and owns its own packet handler
+  * state. Connections are driven by a few epoll worker threads.
+  */
+
+#ifndef BATAPP_DAEMON_H
+#define BATAPP_DAEMON_H
+
+#include <stdbool.h>
+
+/* The default number of epoll worker threads */
+#define BATAPP_DAEMON_THREADS	4
+/* The maximum number of epoll worker threads */
+#define BATAPP_DAEMON_MAXTHREADS	256
+
+/**
+  * This function runs the ingestion daemon until SIGINT or SIGTERM
+  * @param sockpath path of the unix domain socket to listen on
+  * @param outdir directory for a log file per connection, NULL to log on stdout
+  * @param nthreads number of epoll worker threads
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_daemon_run(const char* sockpath, const char* outdir, int nthreads);
+
+#endif //BATAPP_DAEMON_H
\ No newline at end of file
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_dedup.c
+  * @brief Duplicate Packet Filter
+  * @author Subhasish Ghosh
+  */
+
+#include <stdlib.h>
+#include <string.h>
+#include "batapp_dedup.h"
+
+/* FNV-1a 64 bit parameters */
+#define BATAPP_DEDUP_FNV_BASIS	0xCBF29CE484222325ULL
+#define BATAPP_DEDUP_FNV_PRIME	0x100000001B3ULL
+
+/**
+  * This function fingerprints a packet
+  * @param pkttype The type of packet header
+  * @param pkt packet data following the packet type
+  * @param pktlen packet length
+  * @return uint64_t the fingerprint
+  */
+static uint64_t batapp_dedup_hash(int pkttype, const unsigned char* pkt, size_t pktlen) {
+	uint64_t hash = (BATAPP_DEDUP_FNV_BASIS ^ (uint8_t)pkttype) * BATAPP_DEDUP_FNV_PRIME;
+	size_t idx;
+
+	for (idx = 0; idx < pktlen; idx++) {
+		hash = (hash ^ pkt[idx]) * BATAPP_DEDUP_FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/**
+  * This function removes the oldest packet from the hash table
+  * @param dedup the duplicate filter
+  * @return void
+  */
+static void batapp_dedup_evict(batapp_dedup_t* dedup) {
+	uint32_t pos = (uint32_t)dedup->fifo[dedup->head].hash & dedup->mask;
+	uint32_t next;
+
+	/* the oldest packet is in the table, find its entry */
+	while (dedup->table[pos] != dedup->head + 1) {
+		pos = (pos + 1) & dedup->mask;
+	}
+	next = pos;
+
+	/* shift back the following entries of the probe run, leaving no hole in it */
+	for (;;) {
+		uint32_t home;
+
+		next = (next + 1) & dedup->mask;
+		if (dedup->table[next] == 0) {
+			break;
+		}
+
+		/* entries whose home is cyclically in (pos, next] stay where they are */
+		home = (uint32_t)dedup->fifo[dedup->table[next] - 1].hash & dedup->mask;
+		if ((pos <= next) ? ((pos < home) && (home <= next)) : ((pos < home) || (home <= next))) {
+			continue;
+		}
+
+		dedup->table[pos] = dedup->table[next];
+		pos = next;
+	}
+
+	dedup->table[pos] = 0;
+}
+
+/**
+  * This function allocates a duplicate filter
+  * @param window number of recent packets to compare against
+  * @return the duplicate filter, NULL on failure
+  */
+batapp_dedup_t* batapp_dedup_init(uint32_t window) {
+	batapp_dedup_t* dedup;
+	uint32_t size = 2;
+
+	/* keep the table at most half full */
+	while ((size < 2 * window) && (size < (1UL << 31))) {
+		size <<= 1;
+	}
+
+	if ((window == 0) || (window > size / 2) || ((dedup = calloc(1, sizeof(batapp_dedup_t))) == NULL)) {
+		return NULL;
+	}
+
+	dedup->window = window;
+	dedup->mask = size - 1;
+	dedup->fifo = malloc(window * sizeof(batapp_dedup_ent_t));
+	dedup->table = calloc(size, sizeof(uint32_t));
+
+	if ((dedup->fifo == NULL) || (dedup->table == NULL)) {
+		batapp_dedup_exit(dedup);
+		return NULL;
+	}
+
+	return dedup;
+}
+
+/**
+  * This function checks a packet against the recent packets and remembers it
+  * @param dedup the duplicate filter
+  * @param pkttype The type of packet header
+  * @param pkt packet data following the packet type
+  * @param pktlen packet length
+  * @return bool returns true if the packet is a duplicate, it is then counted as dropped
+  */
+bool batapp_dedup_check(batapp_dedup_t* dedup, int pkttype, const void* pkt, size_t pktlen) {
+	uint64_t hash = batapp_dedup_hash(pkttype, pkt, pktlen);
+	uint32_t pos = (uint32_t)hash & dedup->mask;
+	uint32_t idx;
+	batapp_dedup_ent_t* ent;
+
+	/* the fingerprint narrows the search, the raw bytes decide */
+	while ((idx = dedup->table[pos]) != 0) {
+		ent = &dedup->fifo[idx - 1];
+		if ((ent->hash == hash) && (ent->pkttype == pkttype) && (memcmp(ent->pkt, pkt, pktlen) == 0)) {
+			dedup->dropped++;
+			return true;
+		}
+		pos = (pos + 1) & dedup->mask;
+	}
+
+	/* when full, the new packet takes the place of the oldest one */
+	if (dedup->len == dedup->window) {
+		batapp_dedup_evict(dedup);
+		/* the eviction may have freed an earlier position of the probe run */
+		pos = (uint32_t)hash & dedup->mask;
+		while (dedup->table[pos] != 0) {
+			pos = (pos + 1) & dedup->mask;
+		}
+	}
+	else {
+		dedup->len++;
+	}
+
+	ent = &dedup->fifo[dedup->head];
+	ent->hash = hash;
+	ent->pkttype = pkttype;
+	memcpy(ent->pkt, pkt, pktlen);
+	dedup->table[pos] = dedup->head + 1;
+
+	if (++dedup->head == dedup->window) {
+		dedup->head = 0;
+	}
+
+	return false;
+}
+
+/**
+  * This function frees a duplicate filter
+  * @param dedup the duplicate filter
+  * @return void
+  */
+void batapp_dedup_exit(batapp_dedup_t* dedup) {
+	if (dedup != NULL) {
+		free(dedup->fifo);
+		free(dedup->table);
+		free(dedup);
+	}
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_dedup.h
+  * @brief Duplicate Packet Filter Interface
+  * @author Subhasish Ghosh
+  *
+  * The duplicate filter remembers the most recent packets of a stream in a
+  * FIFO and indexes them with an open addressing hash table of at least
+  * twice the FIFO length. A packet is a duplicate if a packet with the same
+  * type and raw bytes is still in the FIFO. The oldest packet leaves the
+  * table (backward shift deletion) when a new one is added to a full FIFO,
+  * so each packet costs O(1) and the memory never grows.
+  */
+
+#ifndef BATAPP_DEDUP_H
+#define BATAPP_DEDUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "batapp_pktparser.h"
+
+/* This struct stores one remembered packet */
+typedef struct {
+	uint64_t		hash;	/* fingerprint of the packet type and bytes */
+	int				pkttype;
+	unsigned char	pkt[BATAPP_PKTPARSER_MAXLEN];
+} batapp_dedup_ent_t;
+
+/* This struct stores the duplicate filter of one packet stream */
+typedef struct batapp_dedup {
+	uint32_t			window;	/* number of packets remembered */
+	uint32_t			len;	/* number of packets remembered so far */
+	uint32_t			head;	/* FIFO index of the oldest packet, and of the next one once full */
+	uint32_t			mask;	/* hash table size - 1 */
+	uint64_t			dropped;/* duplicates dropped */
+	batapp_dedup_ent_t*	fifo;
+	uint32_t*			table;	/* FIFO index + 1 of each entry, 0 if empty */
+} batapp_dedup_t;
+
+/**
+  * This function allocates a duplicate filter
+  * @param window number of recent packets to compare against
+  * @return the duplicate filter, NULL on failure
+  */
+extern batapp_dedup_t* batapp_dedup_init(uint32_t window);
+
+/**
+  * This function checks a packet against the recent packets and remembers it
+  * @param dedup the duplicate filter
+  * @param pkttype The type of packet header
+  * @param pkt packet data following the packet type
+  * @param pktlen packet length
+  * @return bool returns true if the packet is a duplicate, it is then counted as dropped
+  */
+extern bool batapp_dedup_check(batapp_dedup_t* dedup, int pkttype, const void* pkt, size_t pktlen);
+
+/**
+  * This function frees a duplicate filter
+  * @param dedup the duplicate filter
+  * @return void
+  */
+extern void batapp_dedup_exit(batapp_dedup_t* dedup);
+
+#endif //BATAPP_DEDUP_H
@@ -11,7 +11,13 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
 #include "batapp_logger.h"
+#include "batapp_trace.h"
+
+/* The log line length formatted on the stack, longer lines are allocated */
+#define BATAPP_LOGGER_LINELEN	256
 
   /*
    * enable debug messages when debugging
@@ -23,30 +29,91 @@ static int loglevel = BATAPP_LOGGER_LEVEL_INFO;
 #endif
 
 /**
-  * This function is used to print logs on the console
+  * This function is used to print logs on a given stream
+  * @param fp The stream to log into
   * @param priority This is the logging priority
   * @param hdr The header string for the type of packet
-  * @param ... variable arguments, similar to printf.
+  * @param args variable arguments, similar to vprintf.
   * @return void
   */
-void batapp_log(int priority, const char* hdr, const char* format, ...) {
-
-	va_list args;
-	va_start(args, format);
+void batapp_vflog(FILE* fp, int priority, const char* hdr, const char* format, va_list args) {
+	char buff[BATAPP_LOGGER_LINELEN];
+	char* line = buff;
+	va_list copy;
+	int hdrlen, msglen;
+	size_t len;
 
 	/* check the priority and if there is any data to log at all */
 	if ((priority <= loglevel) && (*format != '\0')) {
-		/* log ERR; for error packets */
-		if (priority == BATAPP_LOGGER_LEVEL_ERROR) {
-			printf("ERR;");
+		BATAPP_TRACE_BEGIN(BATAPP_TRACE_LOG_FLUSH, priority);
+		/* log ERR; for error packets, then add the packet header */
+		hdrlen = snprintf(buff, sizeof(buff), "%s%s;", (priority == BATAPP_LOGGER_LEVEL_ERROR) ? "ERR;" : "", hdr);
+		if ((hdrlen < 0) || (hdrlen >= (int)sizeof(buff))) {
+			BATAPP_TRACE_END(BATAPP_TRACE_LOG_FLUSH);
+			return;
 		}
-		/* add the packet header */
-		printf("%s;", hdr);
-		vprintf(format, args);
-		/* ensure a \n at the end */
-		printf("\n");
+
+		va_copy(copy, args);
+		msglen = vsnprintf(buff + hdrlen, sizeof(buff) - hdrlen, format, copy);
+		va_end(copy);
+		if (msglen < 0) {
+			BATAPP_TRACE_END(BATAPP_TRACE_LOG_FLUSH);
+			return;
+		}
+
+		/* a line too long for the stack buffer is formatted again into one of its size */
+		len = (size_t)hdrlen + (size_t)msglen;
+		if (len + 2 > sizeof(buff)) {
+			if ((line = malloc(len + 2)) != NULL) {
+				memcpy(line, buff, hdrlen);
+				vsnprintf(line + hdrlen, (size_t)msglen + 1, format, args);
+			}
+			else {
+				/* out of memory, the line is cut to the stack buffer */
+				line = buff;
+				len = sizeof(buff) - 2;
+			}
+		}
+
+		line[len] = '\n';
+		line[len + 1] = '\0';
+		/* write the whole line at once, this keeps lines from several threads apart */
+		fputs(line, fp);
+		if (line != buff) {
+			free(line);
+		}
+		BATAPP_TRACE_END(BATAPP_TRACE_LOG_FLUSH);
 	}
+}
 
+/**
+  * This function is used to print logs on a given stream
+  * @param fp The stream to log into
+  * @param priority This is the logging priority
+  * @param hdr The header string for the type of packet
+  * @param ... variable arguments, similar to printf.
+  * @return void
+  */
+void batapp_flog(FILE* fp, int priority, const char* hdr, const char* format, ...) {
+
+	va_list args;
+	va_start(args, format);
+	batapp_vflog(fp, priority, hdr, format, args);
+	va_end(args);
+}
+
+/**
+  * This function is used to print logs on the console
+  * @param priority This is the logging priority
+  * @param hdr The header string for the type of packet
+  * @param ... variable arguments, similar to printf.
+  * @return void
+  */
+void batapp_log(int priority, const char* hdr, const char* format, ...) {
+
+	va_list args;
+	va_start(args, format);
+	batapp_vflog(stdout, priority, hdr, format, args);
 	va_end(args);
 }
 
@@ -12,6 +12,9 @@
 #ifndef BATAPP_LOGGER_H
 #define BATAPP_LOGGER_H
 
+#include <stdarg.h>
+#include <stdio.h>
+
  /**
    * This function is used to print logs on the console
    * @param priority This is the logging priority
@@ -21,6 +24,26 @@
    */
 extern void batapp_log(int priority, const char* hdr, const char* format, ...);
 
+/**
+  * This function is used to print logs on a given stream
+  * @param fp The stream to log into
+  * @param priority This is the logging priority
+  * @param hdr The header string for the type of packet
+  * @param ... variable arguments, similar to printf.
+  * @return void
+  */
+extern void batapp_flog(FILE* fp, int priority, const char* hdr, const char* format, ...);
+
+/**
+  * This function is used to print logs on a given stream
+  * @param fp The stream to log into
+  * @param priority This is the logging priority
+  * @param hdr The header string for the type of packet
+  * @param args variable arguments, similar to vprintf.
+  * @return void
+  */
+extern void batapp_vflog(FILE* fp, int priority, const char* hdr, const char* format, va_list args);
+
 /**
   * This function is used to the set the log level
   * @param level The log level setting
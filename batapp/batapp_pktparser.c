@@ -11,9 +11,16 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include "batapp_dedup.h"
 #include "batapp_logger.h"
+#include "batapp_pktparser.h"
 #include "batapp_pkttypes.h"
 #include "batapp_pktutils.h"
+#include "batapp_reorder.h"
+#include "batapp_rules.h"
+#include "batapp_shmring.h"
+#include "batapp_trace.h"
 
   /**
    * batapp_pktobj is an array of function pointers, used to return
@@ -28,6 +35,237 @@ static batapp_pktops_t* (*batapp_pktobj[BATAPP_PACKETTYPE_MAX])(void) = {
 	 */
 };
 
+/* reorder window in ms and depth for new packet streams, no reordering by default */
+static uint32_t batapp_pktparser_window = 0;
+static uint32_t batapp_pktparser_depth = 0;
+/* number of recent packets compared for duplicates in new packet streams, no filter by default */
+static uint32_t batapp_pktparser_dedup = 0;
+
+/**
+  * This function sets the duplicate filter for the packet streams opened afterwards
+  * @param window number of recent packets to compare against, 0 to disable the filter
+  * @return void
+  */
+void batapp_pktparser_setdedup(uint32_t window) {
+	batapp_pktparser_dedup = window;
+}
+
+/**
+  * This function sets the reorder window for the packet streams opened afterwards
+  * @param window reorder window in ms, 0 to disable reordering
+  * @param depth maximum number of packets held per stream, 0 for the default
+  * @return void
+  */
+void batapp_pktparser_setreorder(uint32_t window, uint32_t depth) {
+	batapp_pktparser_window = window;
+	batapp_pktparser_depth = depth;
+}
+
+/**
+  * This function inits the packet handlers for one packet stream
+  * @param parser the packet stream to init
+  * @param out stream the packet logs are printed on
+  * @return bool returns success/failure for the function
+  */
+bool batapp_pktparser_open(batapp_pktparser_t* parser, FILE* out) {
+	int pkttype;
+
+	memset(parser, 0, sizeof(*parser));
+	parser->out = out;
+
+	/* Initialize all registered packet types */
+	for (pkttype = 0; pkttype < ARRAY_SIZE(batapp_pktobj); pkttype++) {
+		if (batapp_pktobj[pkttype] != NULL) {
+			batapp_pktops_t* pktops = batapp_pktobj[pkttype]();
+
+			if ((pktops->pktlen > BATAPP_PKTPARSER_MAXLEN) ||
+				((parser->ctx[pkttype] = pktops->init(0)) == NULL)) {
+				batapp_flog(out, BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTPARSER_HDR, "Failed to init packet type %d", pkttype);
+				batapp_pktparser_close(parser);
+				return false;
+			}
+		}
+	}
+
+	/* drop retransmitted packets before anything else if requested */
+	if (batapp_pktparser_dedup > 0) {
+		if ((parser->dedup = batapp_dedup_init(batapp_pktparser_dedup)) == NULL) {
+			batapp_flog(out, BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTPARSER_HDR, "Failed to init duplicate filter");
+			batapp_pktparser_close(parser);
+			return false;
+		}
+	}
+
+	/* reorder the packets before the state machines if requested */
+	if (batapp_pktparser_window > 0) {
+		if ((parser->reorder = batapp_reorder_init(batapp_pktparser_window, batapp_pktparser_depth)) == NULL) {
+			batapp_flog(out, BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTPARSER_HDR, "Failed to init reorder buffer");
+			batapp_pktparser_close(parser);
+			return false;
+		}
+	}
+
+	/* evaluate the alert rules on the events if loaded */
+	parser->rules = batapp_rules_init();
+
+	return true;
+}
+
+/**
+  * This function returns the packet length following the packet type byte
+  * @param pkttype The type of packet header
+  * @return size_t the packet length, 0 for an invalid packet type
+  */
+size_t batapp_pktparser_pktlen(int pkttype) {
+	/* check packet type is correct */
+	if ((pkttype >= BATAPP_PACKETTYPE_MAX) || (pkttype < BATAPP_PACKETTYPE_MIN) ||
+		(batapp_pktobj[pkttype] == NULL)) {
+		return 0;
+	}
+
+	return batapp_pktobj[pkttype]()->pktlen;
+}
+
+/**
+  * This function cycles the packet type state machine once and prints the log
+  * @param parser the packet stream
+  * @param pkttype The type of packet header, checked with batapp_pktparser_pktlen
+  * @param pkt packet data following the packet type
+  * @return bool returns success/failure for the function
+  */
+static bool batapp_pktparser_step(batapp_pktparser_t* parser, int pkttype, const void* pkt) {
+	/* get the packet handler based upon the pkttype */
+	batapp_pktops_t* pktops = batapp_pktobj[pkttype]();
+	void* ctx = parser->ctx[pkttype];
+	const batapp_pktevent_t* event;
+	bool retval;
+
+	/* cycle the pkttype state machine once and print log */
+	BATAPP_TRACE_BEGIN(BATAPP_TRACE_PKT_STEP, pkttype);
+	retval = pktops->step(ctx, pkt);
+	BATAPP_TRACE_END(BATAPP_TRACE_PKT_STEP);
+	if (retval) {
+		batapp_flog(parser->out, BATAPP_LOGGER_LEVEL_INFO, pktops->pkthdr, pktops->getlogbuff(ctx));
+	}
+	else {
+		/* in case of error, print as ERR: */
+		batapp_flog(parser->out, BATAPP_LOGGER_LEVEL_ERROR, pktops->pkthdr, pktops->getlogbuff(ctx));
+	}
+
+	/* evaluate the alert rules, then publish the binary event to the shared memory ring, if open */
+	event = pktops->getevent(ctx);
+	if (event->kind != BATAPP_PKTEVENT_NONE) {
+		batapp_rules_eval(parser->rules, parser->id, event);
+		if (event->kind != BATAPP_PKTEVENT_SAMPLE) {
+			batapp_shmring_publish(parser->id, event);
+		}
+	}
+
+	return retval;
+}
+
+/**
+  * This function drops duplicate packets, then cycles the packet type state machine and
+  * prints the log, for every packet released by the reorder buffer, or for this packet without one
+  * @param parser the packet stream
+  * @param pkttype The type of packet header, checked with batapp_pktparser_pktlen
+  * @param pkt packet data following the packet type
+  * @return bool returns success/failure for the function
+  */
+bool batapp_pktparser_feed(batapp_pktparser_t* parser, int pkttype, const void* pkt) {
+	const batapp_reorder_slot_t* slot;
+	size_t pktlen;
+	uint32_t ts;
+	bool retval = true;
+
+	pktlen = batapp_pktobj[pkttype]()->pktlen;
+
+	/* a retransmitted packet must not be accounted twice */
+	if ((parser->dedup != NULL) && batapp_dedup_check(parser->dedup, pkttype, pkt, pktlen)) {
+		return retval;
+	}
+
+	/* without a reorder window, packets go straight to the state machine */
+	if (parser->reorder == NULL) {
+		return batapp_pktparser_step(parser, pkttype, pkt);
+	}
+
+	/* a corrupt packet has no trustworthy time stamp, let the state machine report it right away */
+	if (!batapp_pkt_error((void*)pkt, pktlen, (batapp_pkttypes_t)pkttype)) {
+		return batapp_pktparser_step(parser, pkttype, pkt);
+	}
+
+	/* all packet types start with the big endian time stamp */
+	memcpy(&ts, pkt, sizeof(ts));
+	ts = batapp_ntohl(ts);
+
+	/* when full, release the oldest packet early to make room */
+	if (!batapp_reorder_push(parser->reorder, ts, pkttype, pkt, pktlen)) {
+		slot = batapp_reorder_pop(parser->reorder, true);
+		retval = batapp_pktparser_step(parser, slot->pkttype, slot->pkt);
+		batapp_reorder_push(parser->reorder, ts, pkttype, pkt, pktlen);
+	}
+
+	/* release the packets the watermark has passed, in time stamp order */
+	while ((slot = batapp_reorder_pop(parser->reorder, false)) != NULL) {
+		if (!batapp_pktparser_step(parser, slot->pkttype, slot->pkt)) {
+			retval = false;
+		}
+	}
+
+	return retval;
+}
+
+/**
+  * This function releases all packets still held by the reorder buffer and
+  * reports the duplicates dropped, at end of stream
+  * @param parser the packet stream
+  * @return bool returns success/failure for the function
+  */
+bool batapp_pktparser_flush(batapp_pktparser_t* parser) {
+	const batapp_reorder_slot_t* slot;
+	bool retval = true;
+
+	if (parser->reorder != NULL) {
+		while ((slot = batapp_reorder_pop(parser->reorder, true)) != NULL) {
+			if (!batapp_pktparser_step(parser, slot->pkttype, slot->pkt)) {
+				retval = false;
+			}
+		}
+	}
+
+	if (parser->dedup != NULL) {
+		batapp_flog(parser->out, BATAPP_LOGGER_LEVEL_INFO, BATAPP_PKTPARSER_HDR, "%llu duplicate packets dropped",
+			(unsigned long long)parser->dedup->dropped);
+	}
+
+	return retval;
+}
+
+/**
+  * This function cleans up the packet handlers of one packet stream
+  * @param parser the packet stream to clean up
+  * @return void
+  */
+void batapp_pktparser_close(batapp_pktparser_t* parser) {
+	int pkttype;
+
+	/* De-initialize all registered packet types */
+	for (pkttype = 0; pkttype < ARRAY_SIZE(batapp_pktobj); pkttype++) {
+		if ((batapp_pktobj[pkttype] != NULL) && (parser->ctx[pkttype] != NULL)) {
+			batapp_pktobj[pkttype]()->exit(parser->ctx[pkttype]);
+			parser->ctx[pkttype] = NULL;
+		}
+	}
+
+	batapp_dedup_exit(parser->dedup);
+	parser->dedup = NULL;
+	batapp_reorder_exit(parser->reorder);
+	parser->reorder = NULL;
+	batapp_rules_exit(parser->rules);
+	parser->rules = NULL;
+}
+
 /**
   * This function implements the core packet processing logic.
   * @param datafilepath This is the data file path
@@ -35,6 +273,8 @@ static batapp_pktops_t* (*batapp_pktobj[BATAPP_PACKETTYPE_MAX])(void) = {
   */
 bool batapp_pktparser_run(const char* datafilepath) {
 	FILE* fp;
+	batapp_pktparser_t parser;
+	unsigned char pkt[BATAPP_PKTPARSER_MAXLEN]; /* packet data following the packet type */
 	bool retval = false;
 	int pkttype;
 
@@ -45,47 +285,55 @@ bool batapp_pktparser_run(const char* datafilepath) {
 	}
 
 	/* Initialize all registered packet types */
-	for (pkttype = 0; pkttype < ARRAY_SIZE(batapp_pktobj); pkttype++) {
-		if (batapp_pktobj[pkttype] != NULL) {
-			batapp_pktobj[pkttype]()->init(0);
-		}
+	if (!batapp_pktparser_open(&parser, stdout)) {
+		fclose(fp);
+		return retval;
 	}
 
 	retval = true;
 
 	/* read packet header and process */
-	while ((pkttype = fgetc(fp)) != EOF) {
-		batapp_pktops_t* pktops;
+	for (;;) {
+		size_t pktlen;
+		bool readok;
+
+		BATAPP_TRACE_BEGIN(BATAPP_TRACE_PARSER_READ, 0);
+		pkttype = fgetc(fp);
+		BATAPP_TRACE_END(BATAPP_TRACE_PARSER_READ);
+		if (pkttype == EOF) {
+			break;
+		}
 
 		/* check packet type is correct */
-		if ((pkttype >= BATAPP_PACKETTYPE_MAX) || (pkttype < BATAPP_PACKETTYPE_MIN)) {
+		if ((pktlen = batapp_pktparser_pktlen(pkttype)) == 0) {
 			batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTPARSER_HDR, "Invalid packet type");
 			retval = false;
-			goto exit_pkttype;
+			break;
 		}
 
-		/* get the packet handler based upon the pkttype */
-		if (batapp_pktobj[pkttype] != NULL) {
-			pktops = batapp_pktobj[pkttype]();
-			/* cycle the pkttype state machine once and print log */
-			if (pktops->step(fp)) {
-				batapp_log(BATAPP_LOGGER_LEVEL_INFO, pktops->pkthdr, pktops->getlogbuff());
-			}
-			else {
-				/* in case of error, print as ERR: */
-				batapp_log(BATAPP_LOGGER_LEVEL_ERROR, pktops->pkthdr, pktops->getlogbuff());
-				retval = false;
-			}
+		/* read the packet */
+		BATAPP_TRACE_BEGIN(BATAPP_TRACE_PKT_READ, pkttype);
+		readok = (fread(pkt, pktlen, 1, fp) == 1);
+		BATAPP_TRACE_END(BATAPP_TRACE_PKT_READ);
+		if (!readok) {
+			batapp_log(BATAPP_LOGGER_LEVEL_ERROR, batapp_pktobj[pkttype]()->pkthdr, "failed to read data file");
+			retval = false;
+			break;
 		}
-	}
 
-exit_pkttype:
-	/* De-initialize all registered packet types */
-	for (pkttype = 0; pkttype < ARRAY_SIZE(batapp_pktobj); pkttype++) {
-		if (batapp_pktobj[pkttype] != NULL) {
-			batapp_pktobj[pkttype]()->exit();
+		/* cycle the pkttype state machine once and print log */
+		if (!batapp_pktparser_feed(&parser, pkttype, pkt)) {
+			retval = false;
 		}
 	}
+
+	/* release the packets still held for reordering */
+	if (!batapp_pktparser_flush(&parser)) {
+		retval = false;
+	}
+
+	/* De-initialize all registered packet types */
+	batapp_pktparser_close(&parser);
 	/* close the file */
 	fclose(fp);
 	return retval;
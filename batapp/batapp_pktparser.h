@@ -12,6 +12,21 @@
 #ifndef BATAPP_PKTPARSER_H
 #define BATAPP_PKTPARSER_H
 #include <stdbool.h>
+#include <stdio.h>
+#include "batapp_pkttypes.h"
+
+/* The maximum packet length following the packet type byte */
+#define BATAPP_PKTPARSER_MAXLEN		64
+
+/* This struct stores the packet handler contexts of one packet stream */
+typedef struct {
+	void* ctx[BATAPP_PACKETTYPE_MAX]; /* state machine context per packet type */
+	struct batapp_dedup* dedup; /* duplicate filter, NULL without a dedup window */
+	struct batapp_reorder* reorder; /* reorder buffer, NULL without a reorder window */
+	struct batapp_rulestate* rules; /* alert rule state, NULL without alert rules */
+	FILE* out; /* stream the packet logs are printed on */
+	uint32_t id; /* stream id the binary events are published with, 0 for a data file */
+} batapp_pktparser_t;
 
   /**
 	* This function implements the core packet processing logic.
@@ -20,4 +35,59 @@
 	*/
 extern bool batapp_pktparser_run(const char* datafilepath);
 
+/**
+  * This function sets the reorder window for the packet streams opened afterwards
+  * @param window reorder window in ms, 0 to disable reordering
+  * @param depth maximum number of packets held per stream, 0 for the default
+  * @return void
+  */
+extern void batapp_pktparser_setreorder(uint32_t window, uint32_t depth);
+
+/**
+  * This function sets the duplicate filter for the packet streams opened afterwards
+  * @param window number of recent packets to compare against, 0 to disable the filter
+  * @return void
+  */
+extern void batapp_pktparser_setdedup(uint32_t window);
+
+/**
+  * This function inits the packet handlers for one packet stream
+  * @param parser the packet stream to init
+  * @param out stream the packet logs are printed on
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_pktparser_open(batapp_pktparser_t* parser, FILE* out);
+
+/**
+  * This function returns the packet length following the packet type byte
+  * @param pkttype The type of packet header
+  * @return size_t the packet length, 0 for an invalid packet type
+  */
+extern size_t batapp_pktparser_pktlen(int pkttype);
+
+/**
+  * This function drops duplicate packets, then cycles the packet type state machine and
+  * prints the log, for every packet released by the reorder buffer, or for this packet without one
+  * @param parser the packet stream
+  * @param pkttype The type of packet header, checked with batapp_pktparser_pktlen
+  * @param pkt packet data following the packet type
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_pktparser_feed(batapp_pktparser_t* parser, int pkttype, const void* pkt);
+
+/**
+  * This function releases all packets still held by the reorder buffer and
+  * reports the duplicates dropped, at end of stream
+  * @param parser the packet stream
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_pktparser_flush(batapp_pktparser_t* parser);
+
+/**
+  * This function cleans up the packet handlers of one packet stream
+  * @param parser the packet stream to clean up
+  * @return void
+  */
+extern void batapp_pktparser_close(batapp_pktparser_t* parser);
+
 #endif //BATAPP_PKTPARSER_H
\ No newline at end of file
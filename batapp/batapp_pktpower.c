@@ -9,9 +9,13 @@
   * @author Subhasish Ghosh
   */
 
+#include <stdlib.h>
+#include <string.h>
 #include "batapp_pkttypes.h"
 #include "batapp_logger.h"
 #include "batapp_pktutils.h"
+#include "batapp_rollup.h"
+#include "batapp_trace.h"
 
   /* The minimum log len */
 #define BATAPP_PKTPOWER_LOGLEN		100UL
@@ -61,22 +65,40 @@ typedef struct {
 	uint32_t ts;
 } batapp_pktpower_state_ch_dat_t;
 
-/* This is the logging buffer provided by the packet type */
-static char* batapp_logbuff = NULL;
+/* This struct stores the power state machine context of one packet stream */
+typedef struct {
+	char* logbuff; /* This is the logging buffer provided by the packet type */
+	batapp_pktevent_t event; /* This is the binary event of the last step */
+	uint32_t acc_dbounce; /* this is used to store the accumulated debounce */
+	/* store acctual, current and previous state and time info*/
+	batapp_pktpower_state_ch_dat_t state_change_data[BATAPP_PKTPOWER_STATE_CH_MAX];
+} batapp_pktpower_ctx_t;
 
 /**
   * This function is used to retrieve the logbuffer
+  * @param ctx power state machine context
   * @return the logbuffer
   */
-static char* batapp_pktpower_getlogbuff(void) {
-	if (batapp_logbuff != NULL) {
-		return batapp_logbuff;
+static char* batapp_pktpower_getlogbuff(void* ctx) {
+	batapp_pktpower_ctx_t* powerctx = ctx;
+
+	if ((powerctx != NULL) && (powerctx->logbuff != NULL)) {
+		return powerctx->logbuff;
 	}
 	else {
 		return "invalid logbuff";
 	}
 }
 
+/**
+  * This function is used to retrieve the binary event of the last step
+  * @param ctx power state machine context
+  * @return the event
+  */
+static const batapp_pktevent_t* batapp_pktpower_getevent(void* ctx) {
+	return &((batapp_pktpower_ctx_t*)ctx)->event;
+}
+
 /**
   * This function returns the correct state depending upon the power level
   * @param v voltage retrieved from the paket
@@ -108,87 +130,115 @@ static batapp_pktpower_state_t batapp_pktpower_getstate(uint32_t v, uint64_t c)
 
 /**
   * This function executes the power state machine once
-  * @param fp file pointer
+  * @param ctx power state machine context
+  * @param pkt packet data following the packet type
   * @return bool returns success/failure for the function
   */
-static bool batapp_pktpower_step(FILE* fp) {
-	/* init local and static variables */
+static bool batapp_pktpower_step(void* ctx, const void* pkt) {
+	/* init local variables */
+	batapp_pktpower_ctx_t* powerctx = ctx;
 	batapp_pktpower_t pktpower; /* this is used to retrieve the aligned packet data */
 	bool retval = false;
-	static uint32_t acc_dbounce = 0; /* this is used to store the accumulated debounce */
-	/* store acctual, current and previous state and time info*/
-	static batapp_pktpower_state_ch_dat_t state_change_data[] = {
-		{BATAPP_PKTPOWER_STATE_0, 0},
-		{BATAPP_PKTPOWER_STATE_0, 0},
-		{BATAPP_PKTPOWER_STATE_0, 0},
-	};
-
-	/* read the packet */
-	if (fread(&pktpower, sizeof(batapp_pktpower_t), 1, fp) != 1) {
-		batapp_pkt_logbuff(batapp_logbuff, "failed to read data file");
-		return retval;
-	}
+	char* batapp_logbuff = powerctx->logbuff;
+	batapp_pktevent_t* batapp_event = &powerctx->event;
+	batapp_pktpower_state_ch_dat_t* state_change_data = powerctx->state_change_data;
+
+	/* copy out the packet */
+	memcpy(&pktpower, pkt, sizeof(batapp_pktpower_t));
+	batapp_event->kind = BATAPP_PKTEVENT_NONE;
 
 	/* check for any packet errors, this gets reported as ERR; while printing the log */
+	BATAPP_TRACE_BEGIN(BATAPP_TRACE_PKT_CHECKSUM, 0);
 	retval = batapp_pkt_error(&pktpower, sizeof(batapp_pktpower_t), BATAPP_PACKETSTYPE_BATTERYPOWER);
+	BATAPP_TRACE_END(BATAPP_TRACE_PKT_CHECKSUM);
 	if (!retval) {
 		batapp_pkt_logbuff(batapp_logbuff, "packet error!");
+		batapp_pkt_event(batapp_event, BATAPP_PKTEVENT_ERROR, BATAPP_PACKETSTYPE_BATTERYPOWER,
+			batapp_ntohl(pktpower.ts), 0, BATAPP_PKTEVENT_ERR_CHECKSUM);
 		return retval;
 	}
 
 	/* update the current state data */
+	BATAPP_TRACE_BEGIN(BATAPP_TRACE_PKT_CLASSIFY, 0);
 	batapp_pktpower_state_t loc_state = batapp_pktpower_getstate(batapp_ntohl(pktpower.v), batapp_ntohll(pktpower.c));
+	BATAPP_TRACE_END(BATAPP_TRACE_PKT_CLASSIFY);
+
+	/* summarise every raw packet passing the error check into the rollup, if enabled */
+	batapp_rollup_power(batapp_ntohl(pktpower.ts), batapp_ntohl(pktpower.v), batapp_ntohll(pktpower.c),
+		(loc_state < BATAPP_PKTPOWER_STATE_MAX) ? (uint8_t)loc_state : BATAPP_ROLLUP_NONE);
+
 	if (loc_state >= BATAPP_PKTPOWER_STATE_MAX) {
 		batapp_pkt_logbuff(batapp_logbuff, "invalid state!");
+		batapp_pkt_event(batapp_event, BATAPP_PKTEVENT_ERROR, BATAPP_PACKETSTYPE_BATTERYPOWER,
+			batapp_ntohl(pktpower.ts), 0, BATAPP_PKTEVENT_ERR_INVALID);
 		return retval;
 	}
 
+	/* a packet older than the previous one would wrap the debounce accumulation */
+	if (batapp_ntohl(pktpower.ts) < state_change_data[BATAPP_PKTPOWER_STATE_CH_PREV].ts) {
+		batapp_pkt_logbuff(batapp_logbuff, "%u;late packet!", batapp_ntohl(pktpower.ts) / 1000);
+		batapp_pkt_event(batapp_event, BATAPP_PKTEVENT_ERROR, BATAPP_PACKETSTYPE_BATTERYPOWER,
+			batapp_ntohl(pktpower.ts), 0, BATAPP_PKTEVENT_ERR_ORDER);
+		return false;
+	}
+
 	state_change_data[BATAPP_PKTPOWER_STATE_CH_CURR].state = batapp_pktpower_getstate(batapp_ntohl(pktpower.v), batapp_ntohll(pktpower.c));
 	state_change_data[BATAPP_PKTPOWER_STATE_CH_CURR].ts = batapp_ntohl(pktpower.ts);
 
 	/* check if the current and previous states are same, then accumulate debounce */
 	if (state_change_data[BATAPP_PKTPOWER_STATE_CH_CURR].state == state_change_data[BATAPP_PKTPOWER_STATE_CH_PREV].state) {
-		acc_dbounce += state_change_data[BATAPP_PKTPOWER_STATE_CH_CURR].ts - state_change_data[BATAPP_PKTPOWER_STATE_CH_PREV].ts;
+		powerctx->acc_dbounce += state_change_data[BATAPP_PKTPOWER_STATE_CH_CURR].ts - state_change_data[BATAPP_PKTPOWER_STATE_CH_PREV].ts;
 	}
 	else {
-		acc_dbounce = 0; /* if new state, then restart accumulating debounce */
+		powerctx->acc_dbounce = 0; /* if new state, then restart accumulating debounce */
 	}
 
 	/* backup current data into previous data */
 	state_change_data[BATAPP_PKTPOWER_STATE_CH_PREV] = state_change_data[BATAPP_PKTPOWER_STATE_CH_CURR];
 
 	/* check if enough debounce is accumulated */
-	if (acc_dbounce >= BATAPP_PKTPOWER_DBOUNCE) {
+	if (powerctx->acc_dbounce >= BATAPP_PKTPOWER_DBOUNCE) {
 		batapp_pktpower_state_t from_state = state_change_data[BATAPP_PKTPOWER_STATE_CH].state;
 		batapp_pktpower_state_t to_state = state_change_data[BATAPP_PKTPOWER_STATE_CH_CURR].state;
 
 		/* check if the state transition is valid */
 		if (batapp_statetable[from_state][to_state]) {
 			/* if valid state, then copy state and timestamp into actual data storage */
-			state_change_data[BATAPP_PKTPOWER_STATE_CH].ts = state_change_data[BATAPP_PKTPOWER_STATE_CH_CURR].ts - acc_dbounce;
+			state_change_data[BATAPP_PKTPOWER_STATE_CH].ts = state_change_data[BATAPP_PKTPOWER_STATE_CH_CURR].ts - powerctx->acc_dbounce;
 			state_change_data[BATAPP_PKTPOWER_STATE_CH].state = state_change_data[BATAPP_PKTPOWER_STATE_CH_CURR].state;
 
 			/* log data if state changed */
 			if (from_state != to_state) {
+				BATAPP_TRACE_MARK(BATAPP_TRACE_PKT_TRANSITION, (from_state << 8) | to_state);
 				batapp_pkt_logbuff(batapp_logbuff, "%u;%u-%u", state_change_data[BATAPP_PKTPOWER_STATE_CH].ts / 1000, from_state, to_state);
+				batapp_pkt_event(batapp_event, BATAPP_PKTEVENT_POWER, BATAPP_PACKETSTYPE_BATTERYPOWER,
+					state_change_data[BATAPP_PKTPOWER_STATE_CH].ts, from_state, to_state);
 			}
 			else {
 				/* don't log anything is same state */
 				batapp_pkt_logbuff(batapp_logbuff, NULL);
+				batapp_pkt_event(batapp_event, BATAPP_PKTEVENT_SAMPLE, BATAPP_PACKETSTYPE_BATTERYPOWER,
+					batapp_ntohl(pktpower.ts), from_state, from_state);
 			}
 		}
 		else {
 			/* log ERR; state transition is not valid */
 			batapp_pkt_logbuff(batapp_logbuff, "%u;%u-%u",
-				(state_change_data[BATAPP_PKTPOWER_STATE_CH_CURR].ts - acc_dbounce) / 1000, from_state, to_state);
+				(state_change_data[BATAPP_PKTPOWER_STATE_CH_CURR].ts - powerctx->acc_dbounce) / 1000, from_state, to_state);
+			batapp_pkt_event(batapp_event, BATAPP_PKTEVENT_ERROR, BATAPP_PACKETSTYPE_BATTERYPOWER,
+				state_change_data[BATAPP_PKTPOWER_STATE_CH_CURR].ts - powerctx->acc_dbounce, from_state, BATAPP_PKTEVENT_ERR_TRANSITION);
+			batapp_event->next = to_state;
 			retval = false;
 		}
 
-		acc_dbounce = 0;
+		powerctx->acc_dbounce = 0;
 	}
 	else {
 		/* if debounce is not reached, then nothing to log */
 		batapp_pkt_logbuff(batapp_logbuff, NULL);
+		batapp_pkt_event(batapp_event, BATAPP_PKTEVENT_SAMPLE, BATAPP_PACKETSTYPE_BATTERYPOWER,
+			batapp_ntohl(pktpower.ts), state_change_data[BATAPP_PKTPOWER_STATE_CH].state,
+			state_change_data[BATAPP_PKTPOWER_STATE_CH].state);
 	}
 
 	return retval;
@@ -197,31 +247,43 @@ static bool batapp_pktpower_step(FILE* fp) {
 /**
   * This function inits the power state machine.
   * @param loglen log buffer length
-  * @return bool returns success/failure for the function
+  * @return the power state machine context, NULL on failure
   */
-static bool batapp_pktpower_init(size_t loglen) {
-	bool retval = false;
+static void* batapp_pktpower_init(size_t loglen) {
+	/* all states start at state 0, time stamp 0 */
+	batapp_pktpower_ctx_t* powerctx = calloc(1, sizeof(batapp_pktpower_ctx_t));
+
+	if (powerctx == NULL)
+		return NULL;
 
 	/* allocate atleast LOGLEN buffer */
 	if (loglen < BATAPP_PKTPOWER_LOGLEN)
 		loglen = BATAPP_PKTPOWER_LOGLEN;
 
-	batapp_logbuff = malloc(loglen);
+	powerctx->logbuff = malloc(loglen);
 
 	/* check if malloc successfully allocated memory */
-	if (batapp_logbuff != NULL)
-		retval = true;
+	if (powerctx->logbuff == NULL) {
+		free(powerctx);
+		return NULL;
+	}
 
-	return retval;
+	*powerctx->logbuff = '\0';
+	return powerctx;
 }
 
 /**
   * This function cleans up the power state machine.
+  * @param ctx power state machine context
   */
-static void batapp_pktpower_exit(void) {
+static void batapp_pktpower_exit(void* ctx) {
+	batapp_pktpower_ctx_t* powerctx = ctx;
 
-	/* free the log buffer */
-	free(batapp_logbuff);
+	if (powerctx != NULL) {
+		/* free the log buffer */
+		free(powerctx->logbuff);
+		free(powerctx);
+	}
 }
 
 /**
@@ -230,8 +292,10 @@ static void batapp_pktpower_exit(void) {
 static batapp_pktops_t batapp_pktpower_ops = {
 	.init = batapp_pktpower_init, /* Init the power state machine */
 	.pkthdr = BATAPP_PKTPOWER_HDR, /* packet header string to print */
+	.pktlen = sizeof(batapp_pktpower_t), /* packet length following the packet type */
 	.step = batapp_pktpower_step, /* core state machine for the packet type */
 	.getlogbuff = batapp_pktpower_getlogbuff, /* retrieve the log bugger */
+	.getevent = batapp_pktpower_getevent, /* retrieve the binary event */
 	.exit = batapp_pktpower_exit, /* cleanup during exit */
 };
 
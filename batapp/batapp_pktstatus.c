@@ -9,9 +9,13 @@
   * @author Subhasish Ghosh
   */
 
+#include <stdlib.h>
+#include <string.h>
 #include "batapp_pkttypes.h"
 #include "batapp_logger.h"
 #include "batapp_pktutils.h"
+#include "batapp_rollup.h"
+#include "batapp_trace.h"
 
   /* The minimum log len */
 #define BATAPP_PKTSTATUS_LOGLEN		100UL
@@ -31,50 +35,77 @@ typedef PACK(struct {
 	uint8_t		error;
 }) batapp_pktstatus_t;
 
-/* This is the logging buffer provided by the packet type */
-static char* batapp_logbuff = NULL;
+/* This struct stores the battery status state machine context of one packet stream */
+typedef struct {
+	char* logbuff; /* This is the logging buffer provided by the packet type */
+	batapp_pktevent_t event; /* This is the binary event of the last step */
+} batapp_pktstatus_ctx_t;
 
 /**
   * This function is used to retrieve the logbuffer
+  * @param ctx battery status state machine context
   * @return the logbuffer
   */
-static char* batapp_pktstatus_getlogbuff(void) {
-	if (batapp_logbuff != NULL) {
-		return batapp_logbuff;
+static char* batapp_pktstatus_getlogbuff(void* ctx) {
+	batapp_pktstatus_ctx_t* statusctx = ctx;
+
+	if ((statusctx != NULL) && (statusctx->logbuff != NULL)) {
+		return statusctx->logbuff;
 	}
 	else {
 		return "invalid logbuff";
 	}
 }
 
+/**
+  * This function is used to retrieve the binary event of the last step
+  * @param ctx battery status state machine context
+  * @return the event
+  */
+static const batapp_pktevent_t* batapp_pktstatus_getevent(void* ctx) {
+	return &((batapp_pktstatus_ctx_t*)ctx)->event;
+}
+
 /**
   * This function executes the battery status state machine once
-  * @param fp file pointer
+  * @param ctx battery status state machine context
+  * @param pkt packet data following the packet type
   * @return bool returns success/failure for the function
   */
-static bool batapp_pktstatus_step(FILE* fp) {
+static bool batapp_pktstatus_step(void* ctx, const void* pkt) {
+	batapp_pktstatus_ctx_t* statusctx = ctx;
 	batapp_pktstatus_t pktstatus;/* this is used to retrieve the aligned packet data */
 	bool retval = false;
+	char* batapp_logbuff = statusctx->logbuff;
+	batapp_pktevent_t* batapp_event = &statusctx->event;
 
-	/* read the packet */
-	if (fread(&pktstatus, sizeof(batapp_pktstatus_t), 1, fp) != 1) {
-		batapp_pkt_logbuff(batapp_logbuff, "failed to read data file\n");
-		return retval;
-	}
+	/* copy out the packet */
+	memcpy(&pktstatus, pkt, sizeof(batapp_pktstatus_t));
+	batapp_event->kind = BATAPP_PKTEVENT_NONE;
 
 	/* check for any packet errors, this gets reported as ERR; while printing the log */
+	BATAPP_TRACE_BEGIN(BATAPP_TRACE_PKT_CHECKSUM, 0);
 	retval = batapp_pkt_error(&pktstatus, sizeof(batapp_pktstatus_t), BATAPP_PACKETSTYPE_BATTERYSTATUS);
+	BATAPP_TRACE_END(BATAPP_TRACE_PKT_CHECKSUM);
 	if (!retval) {
 		batapp_pkt_logbuff(batapp_logbuff, "packet error!");
+		batapp_pkt_event(batapp_event, BATAPP_PKTEVENT_ERROR, BATAPP_PACKETSTYPE_BATTERYSTATUS,
+			batapp_ntohl(pktstatus.ts), 0, BATAPP_PKTEVENT_ERR_CHECKSUM);
 		return retval;
 	}
 
 	/* log battery status */
+	BATAPP_TRACE_MARK(BATAPP_TRACE_PKT_CLASSIFY, pktstatus.status);
 	if (pktstatus.status < ARRAY_SIZE(batapp_status)) {
+		batapp_rollup_status(batapp_ntohl(pktstatus.ts), pktstatus.status);
 		batapp_pkt_logbuff(batapp_logbuff, "%u;%s", batapp_ntohl(pktstatus.ts) / 1000, batapp_status[pktstatus.status]);
+		batapp_pkt_event(batapp_event, BATAPP_PKTEVENT_STATUS, BATAPP_PACKETSTYPE_BATTERYSTATUS,
+			batapp_ntohl(pktstatus.ts), 0, pktstatus.status);
 	}
 	else {
 		batapp_pkt_logbuff(batapp_logbuff, "invalid status!");
+		batapp_pkt_event(batapp_event, BATAPP_PKTEVENT_ERROR, BATAPP_PACKETSTYPE_BATTERYSTATUS,
+			batapp_ntohl(pktstatus.ts), 0, BATAPP_PKTEVENT_ERR_INVALID);
 		retval = false;
 	}
 
@@ -84,31 +115,42 @@ static bool batapp_pktstatus_step(FILE* fp) {
 /**
   * This function inits the battery status state machine.
   * @param loglen log buffer length
-  * @return bool returns success/failure for the function
+  * @return the battery status state machine context, NULL on failure
   */
-static bool batapp_pktstatus_init(size_t loglen) {
-	bool retval = false;
+static void* batapp_pktstatus_init(size_t loglen) {
+	batapp_pktstatus_ctx_t* statusctx = calloc(1, sizeof(batapp_pktstatus_ctx_t));
+
+	if (statusctx == NULL)
+		return NULL;
 
 	/* allocate atleast LOGLEN buffer */
 	if (loglen < BATAPP_PKTSTATUS_LOGLEN)
 		loglen = BATAPP_PKTSTATUS_LOGLEN;
 
-	batapp_logbuff = malloc(loglen);
+	statusctx->logbuff = malloc(loglen);
 
 	/* check if malloc successfully allocated memory */
-	if (batapp_logbuff != NULL)
-		retval = true;
+	if (statusctx->logbuff == NULL) {
+		free(statusctx);
+		return NULL;
+	}
 
-	return retval;
+	*statusctx->logbuff = '\0';
+	return statusctx;
 }
 
 /**
   * This function cleans up the battery status state machine.
+  * @param ctx battery status state machine context
   */
-static void batapp_pktstatus_exit(void) {
+static void batapp_pktstatus_exit(void* ctx) {
+	batapp_pktstatus_ctx_t* statusctx = ctx;
 
-	/* free the log buffer */
-	free(batapp_logbuff);
+	if (statusctx != NULL) {
+		/* free the log buffer */
+		free(statusctx->logbuff);
+		free(statusctx);
+	}
 }
 
 /**
@@ -117,8 +159,10 @@ static void batapp_pktstatus_exit(void) {
 static batapp_pktops_t batapp_pktstatus_ops = {
 	.init = batapp_pktstatus_init, /* Init the battery status state machine */
 	.pkthdr = BATAPP_PKTSTATUS_HDR, /* packet header string to print */
+	.pktlen = sizeof(batapp_pktstatus_t), /* packet length following the packet type */
 	.step = batapp_pktstatus_step, /* core state machine for the packet type */
 	.getlogbuff = batapp_pktstatus_getlogbuff, /* retrieve the log bugger */
+	.getevent = batapp_pktstatus_getevent, /* retrieve the binary event */
 	.exit = batapp_pktstatus_exit, /* cleanup during exit */
 };
 
@@ -22,6 +22,11 @@
 #define BATAPP_PKTPARSER_HDR	"Z"
 #define BATAPP_PKTMAIN_HDR		"M"
 #define BATAPP_PKTERROR_HDR		"ERR"
+#define BATAPP_PKTTRACE_HDR		"T"
+#define BATAPP_PKTROLLUP_HDR	"R"
+#define BATAPP_PKTDAEMON_HDR	"D"
+#define BATAPP_PKTEVENT_HDR		"E"
+#define BATAPP_PKTALERT_HDR		"A"
 
 /* packet types currently defined */
 typedef enum {
@@ -31,23 +36,62 @@ typedef enum {
 	BATAPP_PACKETTYPE_MAX
 } batapp_pkttypes_t;
 
-/* Common Operations defined for all packet types */
+/* binary event kinds reported by the packet types */
+typedef enum {
+	BATAPP_PKTEVENT_NONE,	/* nothing to report for this packet */
+	BATAPP_PKTEVENT_POWER,	/* power state transition, prev -> val */
+	BATAPP_PKTEVENT_STATUS,	/* battery status level in val */
+	BATAPP_PKTEVENT_ERROR,	/* packet error, batapp_pktevent_err_t in val */
+	BATAPP_PKTEVENT_SAMPLE,	/* power packet without a state change, debounced state in val */
+} batapp_pktevent_kind_t;
+
+/* error codes of BATAPP_PKTEVENT_ERROR events */
+typedef enum {
+	BATAPP_PKTEVENT_ERR_NONE,
+	BATAPP_PKTEVENT_ERR_CHECKSUM,	/* packet error check failed, ts is unreliable */
+	BATAPP_PKTEVENT_ERR_INVALID,	/* invalid power state or status level */
+	BATAPP_PKTEVENT_ERR_TRANSITION,	/* invalid power state transition */
+	BATAPP_PKTEVENT_ERR_ORDER,		/* packet older than the previous one */
+} batapp_pktevent_err_t;
+
+/* fixed layout binary event, filled by .step alongside the log buffer */
+typedef struct {
+	uint32_t	ts;		/* packet time stamp in ms */
+	uint8_t		kind;	/* batapp_pktevent_kind_t */
+	uint8_t		pkttype;/* batapp_pkttypes_t */
+	uint8_t		prev;	/* previous power state */
+	uint8_t		val;	/* power state, status level or error code */
+	uint8_t		next;	/* rejected power state of a BATAPP_PKTEVENT_ERR_TRANSITION error, 0 otherwise */
+	uint8_t		rsvd[3];
+} batapp_pktevent_t;
+
+/*
+ * Common Operations defined for all packet types
+ * Each packet stream (data file or connection) owns its own state machine
+ * context, returned by init and passed back to the other operations.
+ */
 typedef struct {
 
-	/* Init the packet state machine */
-	bool (*init)(size_t loglen);
+	/* Init the packet state machine, returns its context or NULL */
+	void* (*init)(size_t loglen);
 
 	/* packet header string to print */
 	const char* pkthdr;
 
-	/* core state machine for the packet type */
-	bool (*step)(FILE* fp);
+	/* packet length following the packet type byte */
+	size_t pktlen;
+
+	/* core state machine for the packet type, pkt holds pktlen bytes */
+	bool (*step)(void* ctx, const void* pkt);
 
 	/* retrieve the log bugger */
-	char* (*getlogbuff)(void);
+	char* (*getlogbuff)(void* ctx);
+
+	/* retrieve the binary event of the last step */
+	const batapp_pktevent_t* (*getevent)(void* ctx);
 
 	/* cleanup during exit */
-	void (*exit)(void);
+	void (*exit)(void* ctx);
 
 } batapp_pktops_t;
 
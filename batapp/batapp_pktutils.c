@@ -12,6 +12,7 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "batapp_pkttypes.h"
 
   /**
@@ -63,4 +64,28 @@ char* batapp_pkt_logbuff(char* logbuff, const char* format, ...) {
 	va_end(args);
 
 	return logbuff;
+}
+
+/**
+  * This function is used to fill the binary event of a packet
+  * @param event pointer to the event to fill
+  * @param kind the batapp_pktevent_kind_t
+  * @param pkttype The type of packet header
+  * @param ts packet time stamp in ms
+  * @param prev previous power state
+  * @param val power state, status level or error code
+  * @return event pointer
+  */
+batapp_pktevent_t* batapp_pkt_event(batapp_pktevent_t* event, batapp_pktevent_kind_t kind,
+	batapp_pkttypes_t pkttype, uint32_t ts, uint8_t prev, uint8_t val) {
+
+	event->ts = ts;
+	event->kind = (uint8_t)kind;
+	event->pkttype = (uint8_t)pkttype;
+	event->prev = prev;
+	event->val = val;
+	event->next = 0;
+	memset(event->rsvd, 0, sizeof(event->rsvd));
+
+	return event;
 }
\ No newline at end of file
@@ -32,4 +32,17 @@ extern bool batapp_pkt_error(void* pkt, size_t len, batapp_pkttypes_t pkttype);
   */
 extern char* batapp_pkt_logbuff(char* logbuff, const char* format, ...);
 
+/**
+  * This function is used to fill the binary event of a packet
+  * @param event pointer to the event to fill
+  * @param kind the batapp_pktevent_kind_t
+  * @param pkttype The type of packet header
+  * @param ts packet time stamp in ms
+  * @param prev previous power state
+  * @param val power state, status level or error code
+  * @return event pointer
+  */
+extern batapp_pktevent_t* batapp_pkt_event(batapp_pktevent_t* event, batapp_pktevent_kind_t kind,
+	batapp_pkttypes_t pkttype, uint32_t ts, uint8_t prev, uint8_t val);
+
 #endif //BATAPP_PKTUTILS_H
\ No newline at end of file
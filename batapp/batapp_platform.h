@@ -18,6 +18,8 @@
 #define batapp_ntohl(a)		be32toh(a)
 #define batapp_ntohll(a)	be64toh(a)
 #define PACK(__Declaration__) __Declaration__ __attribute__((__packed__))
+#define batapp_tls			__thread
+#define batapp_ctz64(a)		__builtin_ctzll(a)
 #else
 #include <winsock2.h>
 #pragma warning(disable:4996)
@@ -25,6 +27,20 @@
 #define batapp_ntohl(a)		ntohl(a)
 #define batapp_ntohll(a)	ntohll(a)
 #define PACK( __Declaration__ ) __pragma( pack(push, 1) ) __Declaration__ __pragma( pack(pop))
+#define batapp_tls			__declspec(thread)
+#include <intrin.h>
+static __inline int batapp_ctz64(uint64_t a) {
+	unsigned long idx;
+#if defined(_WIN64)
+	_BitScanForward64(&idx, a);
+#else
+	if (!_BitScanForward(&idx, (unsigned long)a)) {
+		_BitScanForward(&idx, (unsigned long)(a >> 32));
+		idx += 32;
+	}
+#endif
+	return (int)idx;
+}
 #endif
 
 #endif //BATAPP_PLATFORM_H
\ No newline at end of file
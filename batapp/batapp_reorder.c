@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_reorder.c
+  * @brief Packet Reorder Buffer
+  * @author Subhasish Ghosh
+  */
+
+#include <stdlib.h>
+#include <string.h>
+#include "batapp_reorder.h"
+
+/**
+  * This function moves a heap entry up to its place
+  * @param heap the heap
+  * @param idx index of the entry to move
+  * @return void
+  */
+static void batapp_reorder_siftup(batapp_reorder_ent_t* heap, uint32_t idx) {
+	batapp_reorder_ent_t ent = heap[idx];
+
+	while (idx > 0) {
+		uint32_t parent = (idx - 1) / 2;
+
+		if (heap[parent].key <= ent.key) {
+			break;
+		}
+		heap[idx] = heap[parent];
+		idx = parent;
+	}
+	heap[idx] = ent;
+}
+
+/**
+  * This function moves a heap entry down to its place
+  * @param heap the heap
+  * @param len number of heap entries
+  * @param idx index of the entry to move
+  * @return void
+  */
+static void batapp_reorder_siftdown(batapp_reorder_ent_t* heap, uint32_t len, uint32_t idx) {
+	batapp_reorder_ent_t ent = heap[idx];
+
+	for (;;) {
+		uint32_t child = 2 * idx + 1;
+
+		if (child >= len) {
+			break;
+		}
+		/* pick the smaller child */
+		if ((child + 1 < len) && (heap[child + 1].key < heap[child].key)) {
+			child++;
+		}
+		if (ent.key <= heap[child].key) {
+			break;
+		}
+		heap[idx] = heap[child];
+		idx = child;
+	}
+	heap[idx] = ent;
+}
+
+/**
+  * This function allocates a reorder buffer
+  * @param window reorder window in ms
+  * @param depth maximum number of packets held, 0 for the default
+  * @return the reorder buffer, NULL on failure
+  */
+batapp_reorder_t* batapp_reorder_init(uint32_t window, uint32_t depth) {
+	batapp_reorder_t* reorder;
+	uint32_t slot;
+
+	if (depth == 0) {
+		depth = BATAPP_REORDER_DEPTH;
+	}
+
+	if ((reorder = calloc(1, sizeof(batapp_reorder_t))) == NULL) {
+		return NULL;
+	}
+
+	reorder->window = window;
+	reorder->depth = depth;
+	reorder->heap = malloc(depth * sizeof(batapp_reorder_ent_t));
+	reorder->slots = malloc(depth * sizeof(batapp_reorder_slot_t));
+	reorder->freeslots = malloc(depth * sizeof(uint32_t));
+
+	if ((reorder->heap == NULL) || (reorder->slots == NULL) || (reorder->freeslots == NULL)) {
+		batapp_reorder_exit(reorder);
+		return NULL;
+	}
+
+	/* all slots start unused */
+	for (slot = 0; slot < depth; slot++) {
+		reorder->freeslots[slot] = depth - 1 - slot;
+	}
+
+	return reorder;
+}
+
+/**
+  * This function adds a packet to the reorder buffer
+  * @param reorder the reorder buffer
+  * @param ts packet time stamp in ms
+  * @param pkttype The type of packet header
+  * @param pkt packet data following the packet type
+  * @param pktlen packet length
+  * @return bool returns false if the buffer is full
+  */
+bool batapp_reorder_push(batapp_reorder_t* reorder, uint32_t ts, int pkttype, const void* pkt, size_t pktlen) {
+	uint32_t slot;
+
+	if ((reorder->len == reorder->depth) || (pktlen > BATAPP_PKTPARSER_MAXLEN)) {
+		return false;
+	}
+
+	slot = reorder->freeslots[reorder->depth - reorder->len - 1];
+	reorder->slots[slot].pkttype = pkttype;
+	memcpy(reorder->slots[slot].pkt, pkt, pktlen);
+
+	reorder->heap[reorder->len].key = ((uint64_t)ts << 32) | reorder->seq++;
+	reorder->heap[reorder->len].slot = slot;
+	batapp_reorder_siftup(reorder->heap, reorder->len);
+	reorder->len++;
+
+	/* the watermark only moves forward */
+	if (ts > reorder->maxts) {
+		reorder->maxts = ts;
+	}
+
+	return true;
+}
+
+/**
+  * This function returns the oldest packet if it is due for release
+  * @param reorder the reorder buffer
+  * @param drain release regardless of the watermark, used at end of stream
+  * @return the released packet, valid until the next push, NULL if none is due
+  */
+const batapp_reorder_slot_t* batapp_reorder_pop(batapp_reorder_t* reorder, bool drain) {
+	uint32_t slot;
+
+	if (reorder->len == 0) {
+		return NULL;
+	}
+
+	/* the oldest packet is due once the watermark has passed it */
+	if (!drain && (((reorder->heap[0].key >> 32) + reorder->window) > reorder->maxts)) {
+		return NULL;
+	}
+
+	slot = reorder->heap[0].slot;
+	reorder->len--;
+	if (reorder->len > 0) {
+		reorder->heap[0] = reorder->heap[reorder->len];
+		batapp_reorder_siftdown(reorder->heap, reorder->len, 0);
+	}
+
+	/* the slot is reused by a later push only */
+	reorder->freeslots[reorder->depth - reorder->len - 1] = slot;
+	return &reorder->slots[slot];
+}
+
+/**
+  * This function frees a reorder buffer
+  * @param reorder the reorder buffer
+  * @return void
+  */
+void batapp_reorder_exit(batapp_reorder_t* reorder) {
+	if (reorder != NULL) {
+		free(reorder->heap);
+		free(reorder->slots);
+		free(reorder->freeslots);
+		free(reorder);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_reorder.h
+  * @brief Packet Reorder Buffer Interface
+  * @author Subhasish Ghosh
+  *
+  * The reorder buffer holds packets in a min-heap keyed by time stamp and
+  * releases them in time stamp order once the watermark (the newest time
+  * stamp seen minus the window) has passed them. Packets with the same
+  * time stamp keep their arrival order. The buffer never holds more than
+  * its depth, the oldest packet is released early when it is full.
+  */
+
+#ifndef BATAPP_REORDER_H
+#define BATAPP_REORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "batapp_pktparser.h"
+
+/* The default maximum number of packets held */
+#define BATAPP_REORDER_DEPTH	1024
+
+/* This struct stores one held packet */
+typedef struct {
+	int				pkttype;
+	unsigned char	pkt[BATAPP_PKTPARSER_MAXLEN];
+} batapp_reorder_slot_t;
+
+/* This struct stores one heap entry, ordered by time stamp then arrival */
+typedef struct {
+	uint64_t	key;	/* time stamp << 32 | arrival sequence */
+	uint32_t	slot;	/* index of the held packet */
+} batapp_reorder_ent_t;
+
+/* This struct stores the reorder buffer of one packet stream */
+typedef struct batapp_reorder {
+	uint32_t				window;	/* reorder window in ms */
+	uint32_t				depth;	/* maximum number of packets held */
+	uint32_t				len;	/* number of packets held */
+	uint32_t				seq;	/* arrival sequence */
+	uint32_t				maxts;	/* newest time stamp seen */
+	batapp_reorder_ent_t*	heap;
+	batapp_reorder_slot_t*	slots;
+	uint32_t*				freeslots; /* stack of unused slot indices */
+} batapp_reorder_t;
+
+/**
+  * This function allocates a reorder buffer
+  * @param window reorder window in ms
+  * @param depth maximum number of packets held, 0 for the default
+  * @return the reorder buffer, NULL on failure
+  */
+extern batapp_reorder_t* batapp_reorder_init(uint32_t window, uint32_t depth);
+
+/**
+  * This function adds a packet to the reorder buffer
+  * @param reorder the reorder buffer
+  * @param ts packet time stamp in ms
+  * @param pkttype The type of packet header
+  * @param pkt packet data following the packet type
+  * @param pktlen packet length
+  * @return bool returns false if the buffer is full, pop the oldest packet with drain first
+  */
+extern bool batapp_reorder_push(batapp_reorder_t* reorder, uint32_t ts, int pkttype, const void* pkt, size_t pktlen);
+
+/**
+  * This function returns the oldest packet if it is due for release
+  * @param reorder the reorder buffer
+  * @param drain release regardless of the watermark, used at end of stream
+  * @return the released packet, valid until the next push, NULL if none is due
+  */
+extern const batapp_reorder_slot_t* batapp_reorder_pop(batapp_reorder_t* reorder, bool drain);
+
+/**
+  * This function frees a reorder buffer
+  * @param reorder the reorder buffer
+  * @return void
+  */
+extern void batapp_reorder_exit(batapp_reorder_t* reorder);
+
+#endif //BATAPP_REORDER_H
\ No newline at end of file
@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_rollup.c
+  * @brief Multi-resolution Rollup Builder and Query
+  * @author Subhasish Ghosh
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batapp_logger.h"
+#include "batapp_pkttypes.h"
+#include "batapp_pktutils.h"
+#include "batapp_rollup.h"
+
+/* window length of each level in ms, finest first */
+static const uint32_t batapp_rollup_windows[BATAPP_ROLLUP_LEVELS] = {
+	1000UL,		/* 1 s */
+	60000UL,	/* 1 min */
+	3600000UL,	/* 1 h */
+};
+
+/* number of power states tracked for the dominant state */
+#define BATAPP_ROLLUP_STATES	4
+/* initial number of records allocated per level */
+#define BATAPP_ROLLUP_INITLEN	256
+
+/* This struct accumulates the currently open window of one level */
+typedef struct {
+	bool		active;
+	uint32_t	start;
+	uint32_t	count;
+	uint32_t	vmin, vmax;
+	uint64_t	cmin, cmax;
+	uint64_t	mwmin, mwmax;
+	double		vsum, csum, mwsum;
+	uint32_t	statecnt[BATAPP_ROLLUP_STATES];
+	uint8_t		status;
+} batapp_rollup_acc_t;
+
+/* This struct stores the closed windows of one level */
+typedef struct {
+	batapp_rollup_acc_t	acc;
+	batapp_rollup_rec_t* rec;
+	uint32_t			len;
+	uint32_t			cap;
+} batapp_rollup_lvl_t;
+
+/* the rollup file path, NULL if the rollup is not enabled */
+static const char* batapp_rollup_path = NULL;
+/* the pyramid levels being built */
+static batapp_rollup_lvl_t batapp_rollup_lvl[BATAPP_ROLLUP_LEVELS];
+/* set if a level could not grow, the rollup is then discarded */
+static bool batapp_rollup_nomem = false;
+
+/**
+  * This function closes the open window of a level into a record
+  * @param lvl the level to close the window for
+  * @return void
+  */
+static void batapp_rollup_emit(batapp_rollup_lvl_t* lvl) {
+	batapp_rollup_acc_t* acc = &lvl->acc;
+	batapp_rollup_rec_t* rec;
+	uint32_t best;
+	int state;
+
+	if (!acc->active) {
+		return;
+	}
+
+	/* grow the record storage by doubling */
+	if (lvl->len == lvl->cap) {
+		uint32_t cap = lvl->cap ? lvl->cap * 2 : BATAPP_ROLLUP_INITLEN;
+		batapp_rollup_rec_t* grown = realloc(lvl->rec, cap * sizeof(batapp_rollup_rec_t));
+
+		if (grown == NULL) {
+			batapp_rollup_nomem = true;
+			return;
+		}
+		lvl->rec = grown;
+		lvl->cap = cap;
+	}
+
+	rec = &lvl->rec[lvl->len++];
+	memset(rec, 0, sizeof(*rec));
+	rec->start = acc->start;
+	rec->count = acc->count;
+	rec->status = acc->status;
+	rec->state = BATAPP_ROLLUP_NONE;
+
+	if (acc->count > 0) {
+		rec->vmin = acc->vmin;
+		rec->vmax = acc->vmax;
+		rec->vmean = (uint32_t)(acc->vsum / acc->count + 0.5);
+		rec->cmin = acc->cmin;
+		rec->cmax = acc->cmax;
+		rec->cmean = (uint64_t)(acc->csum / acc->count + 0.5);
+		rec->mwmin = acc->mwmin;
+		rec->mwmax = acc->mwmax;
+		rec->mwmean = (uint64_t)(acc->mwsum / acc->count + 0.5);
+
+		/* the dominant state is the one seen most often, lowest state on a tie, none if no packet had a state */
+		best = 0;
+		for (state = 0; state < BATAPP_ROLLUP_STATES; state++) {
+			if (acc->statecnt[state] > best) {
+				best = acc->statecnt[state];
+				rec->state = (uint8_t)state;
+			}
+		}
+	}
+}
+
+/**
+  * This function returns the open window of a level for a time stamp,
+  * closing the previous window if the time stamp is past it
+  * @param lvlidx the level index
+  * @param ts packet time stamp in ms
+  * @return the window accumulator, NULL if the time stamp is older than the open window
+  */
+static batapp_rollup_acc_t* batapp_rollup_window(int lvlidx, uint32_t ts) {
+	batapp_rollup_lvl_t* lvl = &batapp_rollup_lvl[lvlidx];
+	batapp_rollup_acc_t* acc = &lvl->acc;
+	uint32_t window = batapp_rollup_windows[lvlidx];
+	uint8_t status = BATAPP_ROLLUP_NONE;
+
+	/* the window of a late packet is already closed, leave it out */
+	if (acc->active && (ts < acc->start)) {
+		return NULL;
+	}
+
+	if (acc->active && ((ts - acc->start) < window)) {
+		return acc;
+	}
+
+	/* close the previous window, the status level carries forward */
+	if (acc->active) {
+		batapp_rollup_emit(lvl);
+		status = acc->status;
+	}
+
+	memset(acc, 0, sizeof(*acc));
+	acc->active = true;
+	acc->start = ts - (ts % window);
+	acc->status = status;
+
+	return acc;
+}
+
+/**
+  * This function enables the rollup for the following parser run
+  * @param rollpath path of the rollup file to write
+  * @return bool returns success/failure for the function
+  */
+bool batapp_rollup_open(const char* rollpath) {
+	FILE* fp;
+
+	/* ensure the rollup file can be written before doing the work */
+	if ((fp = fopen(rollpath, "wb")) == NULL) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTROLLUP_HDR, "Failed to open rollup file");
+		return false;
+	}
+	fclose(fp);
+
+	memset(batapp_rollup_lvl, 0, sizeof(batapp_rollup_lvl));
+	batapp_rollup_nomem = false;
+	batapp_rollup_path = rollpath;
+	return true;
+}
+
+/**
+  * This function adds one power packet to the rollup
+  * @param ts packet time stamp in ms
+  * @param v voltage retrieved from the packet
+  * @param c current retrieved from the packet
+  * @param state the classified power state
+  * @return void
+  */
+void batapp_rollup_power(uint32_t ts, uint32_t v, uint64_t c, uint8_t state) {
+	uint64_t mwatt = v * c;
+	int lvlidx;
+
+	if (batapp_rollup_path == NULL) {
+		return;
+	}
+
+	for (lvlidx = 0; lvlidx < BATAPP_ROLLUP_LEVELS; lvlidx++) {
+		batapp_rollup_acc_t* acc = batapp_rollup_window(lvlidx, ts);
+
+		if (acc == NULL) {
+			continue;
+		}
+
+		if (acc->count == 0) {
+			acc->vmin = acc->vmax = v;
+			acc->cmin = acc->cmax = c;
+			acc->mwmin = acc->mwmax = mwatt;
+		}
+		else {
+			if (v < acc->vmin) acc->vmin = v;
+			if (v > acc->vmax) acc->vmax = v;
+			if (c < acc->cmin) acc->cmin = c;
+			if (c > acc->cmax) acc->cmax = c;
+			if (mwatt < acc->mwmin) acc->mwmin = mwatt;
+			if (mwatt > acc->mwmax) acc->mwmax = mwatt;
+		}
+
+		acc->vsum += v;
+		acc->csum += (double)c;
+		acc->mwsum += (double)mwatt;
+		if (state < BATAPP_ROLLUP_STATES) {
+			acc->statecnt[state]++;
+		}
+		acc->count++;
+	}
+}
+
+/**
+  * This function adds one status packet to the rollup
+  * @param ts packet time stamp in ms
+  * @param status the battery status level
+  * @return void
+  */
+void batapp_rollup_status(uint32_t ts, uint8_t status) {
+	int lvlidx;
+
+	if (batapp_rollup_path == NULL) {
+		return;
+	}
+
+	for (lvlidx = 0; lvlidx < BATAPP_ROLLUP_LEVELS; lvlidx++) {
+		batapp_rollup_acc_t* acc = batapp_rollup_window(lvlidx, ts);
+
+		if (acc != NULL) {
+			acc->status = status;
+		}
+	}
+}
+
+/**
+  * This function flushes the open windows and writes the rollup file
+  * @return bool returns success/failure for the function
+  */
+bool batapp_rollup_close(void) {
+	batapp_rollup_hdr_t hdr;
+	FILE* fp = NULL;
+	bool retval = false;
+	uint32_t offset = sizeof(hdr);
+	int lvlidx;
+
+	if (batapp_rollup_path == NULL) {
+		return true;
+	}
+
+	/* close the last open windows */
+	for (lvlidx = 0; lvlidx < BATAPP_ROLLUP_LEVELS; lvlidx++) {
+		batapp_rollup_emit(&batapp_rollup_lvl[lvlidx]);
+	}
+
+	if (batapp_rollup_nomem) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTROLLUP_HDR, "Failed to allocate rollup records");
+		goto exit_rollup;
+	}
+
+	/* build the level directory, levels follow the header finest first */
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = BATAPP_ROLLUP_MAGIC;
+	hdr.version = BATAPP_ROLLUP_VERSION;
+	for (lvlidx = 0; lvlidx < BATAPP_ROLLUP_LEVELS; lvlidx++) {
+		hdr.level[lvlidx].window = batapp_rollup_windows[lvlidx];
+		hdr.level[lvlidx].count = batapp_rollup_lvl[lvlidx].len;
+		hdr.level[lvlidx].offset = offset;
+		offset += batapp_rollup_lvl[lvlidx].len * sizeof(batapp_rollup_rec_t);
+	}
+
+	if ((fp = fopen(batapp_rollup_path, "wb")) == NULL) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTROLLUP_HDR, "Failed to open rollup file");
+		goto exit_rollup;
+	}
+
+	retval = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1);
+	for (lvlidx = 0; retval && (lvlidx < BATAPP_ROLLUP_LEVELS); lvlidx++) {
+		batapp_rollup_lvl_t* lvl = &batapp_rollup_lvl[lvlidx];
+
+		if (lvl->len > 0) {
+			retval = (fwrite(lvl->rec, sizeof(batapp_rollup_rec_t), lvl->len, fp) == lvl->len);
+		}
+	}
+
+	if (!retval) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTROLLUP_HDR, "Failed to write rollup file");
+	}
+	fclose(fp);
+
+exit_rollup:
+	for (lvlidx = 0; lvlidx < BATAPP_ROLLUP_LEVELS; lvlidx++) {
+		free(batapp_rollup_lvl[lvlidx].rec);
+	}
+	memset(batapp_rollup_lvl, 0, sizeof(batapp_rollup_lvl));
+	batapp_rollup_path = NULL;
+
+	return retval;
+}
+
+/**
+  * This function reads one record of a level from the rollup file
+  * @param fp rollup file pointer
+  * @param lvl the level directory entry
+  * @param idx record index within the level
+  * @param rec pointer to read the record into
+  * @return bool returns success/failure for the function
+  */
+static bool batapp_rollup_read(FILE* fp, const batapp_rollup_level_t* lvl, uint32_t idx, batapp_rollup_rec_t* rec) {
+	if (fseek(fp, (long)(lvl->offset + idx * sizeof(batapp_rollup_rec_t)), SEEK_SET) != 0) {
+		return false;
+	}
+	return (fread(rec, sizeof(batapp_rollup_rec_t), 1, fp) == 1);
+}
+
+/**
+  * This function prints the rollup records for a time range
+  * @param rollpath path of the rollup file
+  * @param from start of the time range in ms
+  * @param to end of the time range in ms
+  * @param res requested resolution in ms, the coarsest level not above it is used
+  * @return bool returns success/failure for the function
+  */
+bool batapp_rollup_query(const char* rollpath, uint32_t from, uint32_t to, uint32_t res) {
+	batapp_rollup_hdr_t hdr;
+	batapp_rollup_level_t* lvl;
+	batapp_rollup_rec_t rec;
+	FILE* fp;
+	bool retval = false;
+	uint32_t lo, hi;
+	int lvlidx;
+
+	if ((fp = fopen(rollpath, "rb")) == NULL) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTROLLUP_HDR, "Failed to open rollup file");
+		return retval;
+	}
+
+	if ((fread(&hdr, sizeof(hdr), 1, fp) != 1) || (hdr.magic != BATAPP_ROLLUP_MAGIC) ||
+		(hdr.version != BATAPP_ROLLUP_VERSION)) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTROLLUP_HDR, "Invalid rollup file");
+		goto exit_query;
+	}
+
+	/* pick the coarsest level not coarser than requested, else the finest */
+	lvl = &hdr.level[0];
+	for (lvlidx = 1; lvlidx < BATAPP_ROLLUP_LEVELS; lvlidx++) {
+		if (hdr.level[lvlidx].window <= res) {
+			lvl = &hdr.level[lvlidx];
+		}
+	}
+
+	/* binary search the first window ending after the range start */
+	lo = 0;
+	hi = lvl->count;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if (!batapp_rollup_read(fp, lvl, mid, &rec)) {
+			batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTROLLUP_HDR, "Truncated rollup file");
+			goto exit_query;
+		}
+
+		if ((rec.start + lvl->window) <= from) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	retval = true;
+
+	/* print the windows overlapping the range */
+	for (; lo < lvl->count; lo++) {
+		if (!batapp_rollup_read(fp, lvl, lo, &rec)) {
+			batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTROLLUP_HDR, "Truncated rollup file");
+			retval = false;
+			break;
+		}
+
+		if (rec.start >= to) {
+			break;
+		}
+
+		batapp_log(BATAPP_LOGGER_LEVEL_INFO, BATAPP_PKTROLLUP_HDR, "%u;%u;%u;%d;%d;%u;%u;%u;%llu;%llu;%llu;%llu;%llu;%llu",
+			rec.start, lvl->window, rec.count,
+			(rec.state == BATAPP_ROLLUP_NONE) ? -1 : rec.state,
+			(rec.status == BATAPP_ROLLUP_NONE) ? -1 : rec.status,
+			rec.vmin, rec.vmax, rec.vmean,
+			(unsigned long long)rec.cmin, (unsigned long long)rec.cmax, (unsigned long long)rec.cmean,
+			(unsigned long long)rec.mwmin, (unsigned long long)rec.mwmax, (unsigned long long)rec.mwmean);
+	}
+
+exit_query:
+	fclose(fp);
+	return retval;
+}
\ No newline at end of file
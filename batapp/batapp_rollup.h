@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_rollup.h
+  * @brief Multi-resolution Rollup Interface
+  * @author Subhasish Ghosh
+  *
+  * The rollup is built in the same pass as the packet parsing. Power and
+  * status packets are summarised into 1 s, 1 min and 1 h windows, which
+  * are written into a compact file that can be queried per time range.
+  */
+
+#ifndef BATAPP_ROLLUP_H
+#define BATAPP_ROLLUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "batapp_platform.h"
+
+/* rollup file magic "BRLP" and format version */
+#define BATAPP_ROLLUP_MAGIC		0x504C5242UL
+#define BATAPP_ROLLUP_VERSION	1
+/* number of resolution levels in the pyramid */
+#define BATAPP_ROLLUP_LEVELS	3
+/* marker for a window without power state or status level */
+#define BATAPP_ROLLUP_NONE		0xFF
+
+/* one summarised window, as written into the rollup file */
+typedef PACK(struct {
+	uint32_t	start;	/* window start time stamp in ms */
+	uint32_t	count;	/* number of power packets in the window */
+	uint32_t	vmin;
+	uint32_t	vmax;
+	uint32_t	vmean;
+	uint64_t	cmin;
+	uint64_t	cmax;
+	uint64_t	cmean;
+	uint64_t	mwmin;
+	uint64_t	mwmax;
+	uint64_t	mwmean;
+	uint8_t		state;	/* dominant power state */
+	uint8_t		status;	/* last battery status level */
+}) batapp_rollup_rec_t;
+
+/* per level directory entry of the rollup file */
+typedef struct {
+	uint32_t	window;	/* window length in ms */
+	uint32_t	count;	/* number of records */
+	uint32_t	offset;	/* file offset of the first record */
+} batapp_rollup_level_t;
+
+/* rollup file header */
+typedef struct {
+	uint32_t				magic;
+	uint32_t				version;
+	batapp_rollup_level_t	level[BATAPP_ROLLUP_LEVELS];
+} batapp_rollup_hdr_t;
+
+/**
+  * This function enables the rollup for the following parser run
+  * @param rollpath path of the rollup file to write
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_rollup_open(const char* rollpath);
+
+/**
+  * This function adds one power packet to the rollup
+  * @param ts packet time stamp in ms
+  * @param v voltage retrieved from the packet
+  * @param c current retrieved from the packet
+  * @param state the classified power state
+  * @return void
+  */
+extern void batapp_rollup_power(uint32_t ts, uint32_t v, uint64_t c, uint8_t state);
+
+/**
+  * This function adds one status packet to the rollup
+  * @param ts packet time stamp in ms
+  * @param status the battery status level
+  * @return void
+  */
+extern void batapp_rollup_status(uint32_t ts, uint8_t status);
+
+/**
+  * This function flushes the open windows and writes the rollup file
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_rollup_close(void);
+
+/**
+  * This function prints the rollup records for a time range
+  * @param rollpath path of the rollup file
+  * @param from start of the time range in ms
+  * @param to end of the time range in ms
+  * @param res requested resolution in ms, the coarsest level not above it is used
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_rollup_query(const char* rollpath, uint32_t from, uint32_t to, uint32_t res);
+
+#endif //BATAPP_ROLLUP_H
\ No newline at end of file
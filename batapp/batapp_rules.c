@@ -0,0 +1,665 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_rules.c
+  * @brief Alert Rule Engine
+  * @author Subhasish Ghosh
+  */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batapp_logger.h"
+#include "batapp_pkttypes.h"
+#include "batapp_pktutils.h"
+#include "batapp_rules.h"
+
+/* number of 64 bit words of a rule bit set */
+#define BATAPP_RULES_WORDS		(BATAPP_RULES_MAX / 64)
+/* power states and status levels, the last index stands for not seen yet */
+#define BATAPP_RULES_STATES		5
+#define BATAPP_RULES_LEVELS		5
+#define BATAPP_RULES_UNKNOWN	4
+/* state or status mask of a rule without such a condition */
+#define BATAPP_RULES_ANY		0x1F
+/* maximum length of a rule file line */
+#define BATAPP_RULES_LINELEN	256
+
+/* error classes counted for the error conditions */
+typedef enum {
+	BATAPP_RULES_ERR_NONE = -1,
+	BATAPP_RULES_ERR_ALL,		/* any packet error */
+	BATAPP_RULES_ERR_CHECKSUM,	/* packet error check failures only */
+	BATAPP_RULES_ERR_MAX,
+} batapp_rules_err_t;
+
+/* This struct stores one compiled rule */
+typedef struct {
+	char				name[BATAPP_RULES_NAMELEN];
+	uint8_t				statemask;	/* bit per power state the rule matches in */
+	uint8_t				statusmask;	/* bit per status level the rule matches in */
+	bool				hasheld;
+	uint32_t			held;		/* state held for more than this, in ms */
+	batapp_rules_err_t	errclass;
+	uint32_t			errcount;	/* more than this many errors */
+	uint32_t			errwindow;	/* within this, in ms */
+} batapp_rules_rule_t;
+
+/* This struct stores one compiled held or error threshold */
+typedef struct {
+	uint32_t	count;	/* error count, unused for held thresholds */
+	uint32_t	limit;	/* held time or error window, in ms */
+	uint32_t	rule;	/* index of the rule */
+} batapp_rules_thr_t;
+
+/* This struct stores the error thresholds of one class sharing the same count */
+typedef struct {
+	uint32_t	count;	/* more than this many errors */
+	uint32_t	first;	/* first threshold, windows are sorted longest first */
+	uint32_t	len;	/* number of thresholds */
+} batapp_rules_grp_t;
+
+/* This struct stores the rule evaluation state of one packet stream */
+struct batapp_rulestate {
+	uint32_t	ts;			/* newest trustworthy time stamp */
+	uint32_t	statets;	/* time stamp the power state was entered */
+	uint8_t		state;		/* debounced power state */
+	uint8_t		status;		/* last status level */
+	uint32_t	heldnext;	/* held thresholds of the power state passed so far */
+	uint64_t	active[BATAPP_RULES_WORDS];		/* rules matching after the last event */
+	uint64_t	heldok[BATAPP_RULES_WORDS];		/* rules whose held condition holds */
+	uint64_t	errok[BATAPP_RULES_WORDS];		/* rules whose error condition holds */
+	uint64_t	errseen[BATAPP_RULES_ERR_MAX];	/* errors seen per class */
+	uint64_t	errfall[BATAPP_RULES_ERR_MAX];	/* an error condition may stop holding after this time stamp */
+	uint32_t*	errts[BATAPP_RULES_ERR_MAX];	/* time stamps of the latest errors per class */
+	uint32_t	errnext[BATAPP_RULES_ERR_MAX][BATAPP_RULES_MAX]; /* error thresholds holding per group */
+};
+
+/* status level names, as printed by the status packet */
+static const char* batapp_rules_levels[] = {
+	"VLOW",
+	"LOW",
+	"MED",
+	"HIGH",
+};
+
+/* the compiled rules */
+static batapp_rules_rule_t batapp_rules[BATAPP_RULES_MAX];
+static uint32_t batapp_rules_len = 0;
+/* decision table, the rules whose state and status conditions hold */
+static uint64_t batapp_rules_table[BATAPP_RULES_STATES][BATAPP_RULES_LEVELS][BATAPP_RULES_WORDS];
+/* the rules with a held condition and with an error condition */
+static uint64_t batapp_rules_heldmask[BATAPP_RULES_WORDS];
+static uint64_t batapp_rules_errmask[BATAPP_RULES_WORDS];
+/* held thresholds per power state, shortest first */
+static batapp_rules_thr_t batapp_rules_heldthr[BATAPP_RULES_UNKNOWN][BATAPP_RULES_MAX];
+static uint32_t batapp_rules_heldlen[BATAPP_RULES_UNKNOWN];
+/* error thresholds per class, grouped by count */
+static batapp_rules_thr_t batapp_rules_errthr[BATAPP_RULES_ERR_MAX][BATAPP_RULES_MAX];
+static uint32_t batapp_rules_errlen[BATAPP_RULES_ERR_MAX];
+static batapp_rules_grp_t batapp_rules_errgrp[BATAPP_RULES_ERR_MAX][BATAPP_RULES_MAX];
+static uint32_t batapp_rules_errgrps[BATAPP_RULES_ERR_MAX];
+/* error time stamps kept per class, a power of 2, 0 if the class is unused */
+static uint32_t batapp_rules_errcap[BATAPP_RULES_ERR_MAX];
+/* the alert sink, NULL if no rules are loaded */
+static FILE* batapp_rules_alertfp = NULL;
+
+/**
+  * This function parses an unsigned decimal number token
+  * @param tok the token
+  * @param val the parsed number
+  * @return bool returns false if the token is not a number or does not fit 32 bits
+  */
+static bool batapp_rules_number(const char* tok, uint32_t* val) {
+	unsigned long num;
+	char* end;
+
+	if ((tok == NULL) || (*tok < '0') || (*tok > '9')) {
+		return false;
+	}
+
+	errno = 0;
+	num = strtoul(tok, &end, 10);
+	if ((*end != '\0') || (errno == ERANGE) || (num > UINT32_MAX)) {
+		return false;
+	}
+
+	*val = (uint32_t)num;
+	return true;
+}
+
+/**
+  * This function parses a status level token, by name or number
+  * @param tok the token
+  * @param val the parsed status level
+  * @return bool returns false if the token is not a status level
+  */
+static bool batapp_rules_level(const char* tok, uint32_t* val) {
+	uint32_t level;
+
+	if (tok == NULL) {
+		return false;
+	}
+
+	for (level = 0; level < ARRAY_SIZE(batapp_rules_levels); level++) {
+		if (strcmp(tok, batapp_rules_levels[level]) == 0) {
+			*val = level;
+			return true;
+		}
+	}
+
+	return (batapp_rules_number(tok, val) && (*val < ARRAY_SIZE(batapp_rules_levels)));
+}
+
+/**
+  * This function compiles the conditions of one rule
+  * @param rule the rule to fill
+  * @param conds the conditions following the rule name, modified by strtok
+  * @return bool returns false if the conditions are invalid
+  */
+static bool batapp_rules_compile(batapp_rules_rule_t* rule, char* conds) {
+	const char* delim = " \t\r\n";
+	char* tok = strtok(conds, delim);
+
+	rule->statemask = BATAPP_RULES_ANY;
+	rule->statusmask = BATAPP_RULES_ANY;
+	rule->errclass = BATAPP_RULES_ERR_NONE;
+
+	/* a rule needs at least one condition */
+	if (tok == NULL) {
+		return false;
+	}
+
+	while (tok != NULL) {
+		const char* field = tok;
+		const char* op = strtok(NULL, delim);
+		const char* arg = strtok(NULL, delim);
+		uint32_t val;
+
+		if ((op == NULL) || (arg == NULL)) {
+			return false;
+		}
+
+		if (strcmp(field, "state") == 0) {
+			/* power states 0-3, an unknown state never matches */
+			if (!batapp_rules_number(arg, &val) || (val >= BATAPP_RULES_UNKNOWN)) {
+				return false;
+			}
+			if (strcmp(op, "==") == 0) {
+				rule->statemask &= (uint8_t)(1U << val);
+			}
+			else if (strcmp(op, "!=") == 0) {
+				rule->statemask &= (uint8_t)(~(1U << val) & ~(1U << BATAPP_RULES_UNKNOWN));
+			}
+			else {
+				return false;
+			}
+		}
+		else if (strcmp(field, "status") == 0) {
+			if (!batapp_rules_level(arg, &val)) {
+				return false;
+			}
+			if (strcmp(op, "==") == 0) {
+				rule->statusmask &= (uint8_t)(1U << val);
+			}
+			else if (strcmp(op, "!=") == 0) {
+				rule->statusmask &= (uint8_t)(~(1U << val) & ~(1U << BATAPP_RULES_UNKNOWN));
+			}
+			else {
+				return false;
+			}
+		}
+		else if (strcmp(field, "held") == 0) {
+			if ((strcmp(op, ">") != 0) || !batapp_rules_number(arg, &rule->held)) {
+				return false;
+			}
+			rule->hasheld = true;
+			/* the state must be known to be held */
+			rule->statemask &= (uint8_t)~(1U << BATAPP_RULES_UNKNOWN);
+		}
+		else if ((strcmp(field, "errors") == 0) || (strcmp(field, "checksum") == 0)) {
+			const char* per = strtok(NULL, delim);
+
+			/* only one error condition per rule */
+			if ((rule->errclass != BATAPP_RULES_ERR_NONE) || (strcmp(op, ">") != 0) ||
+				!batapp_rules_number(arg, &rule->errcount) || (rule->errcount >= BATAPP_RULES_MAXERRORS) ||
+				(per == NULL) || (strcmp(per, "per") != 0) ||
+				!batapp_rules_number(strtok(NULL, delim), &rule->errwindow)) {
+				return false;
+			}
+			rule->errclass = (field[0] == 'e') ? BATAPP_RULES_ERR_ALL : BATAPP_RULES_ERR_CHECKSUM;
+		}
+		else {
+			return false;
+		}
+
+		/* conditions are joined with and */
+		if ((tok = strtok(NULL, delim)) != NULL) {
+			if ((strcmp(tok, "and") != 0) || ((tok = strtok(NULL, delim)) == NULL)) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+  * This function adds a compiled rule to the decision table and the threshold arrays
+  * @param idx index of the rule
+  * @return void
+  */
+static void batapp_rules_addtable(uint32_t idx) {
+	const batapp_rules_rule_t* rule = &batapp_rules[idx];
+	uint64_t bit = 1ULL << (idx % 64);
+	int state, level;
+
+	for (state = 0; state < BATAPP_RULES_STATES; state++) {
+		for (level = 0; level < BATAPP_RULES_LEVELS; level++) {
+			if ((rule->statemask & (1U << state)) && (rule->statusmask & (1U << level))) {
+				batapp_rules_table[state][level][idx / 64] |= bit;
+			}
+		}
+	}
+
+	/* a held threshold for every power state the rule matches in */
+	if (rule->hasheld) {
+		batapp_rules_heldmask[idx / 64] |= bit;
+		for (state = 0; state < BATAPP_RULES_UNKNOWN; state++) {
+			if (rule->statemask & (1U << state)) {
+				batapp_rules_thr_t* thr = &batapp_rules_heldthr[state][batapp_rules_heldlen[state]++];
+
+				thr->limit = rule->held;
+				thr->rule = idx;
+			}
+		}
+	}
+
+	/* keep enough error time stamps to look back errcount + 1 errors */
+	if (rule->errclass != BATAPP_RULES_ERR_NONE) {
+		batapp_rules_thr_t* thr = &batapp_rules_errthr[rule->errclass][batapp_rules_errlen[rule->errclass]++];
+		uint32_t cap = 1;
+
+		batapp_rules_errmask[idx / 64] |= bit;
+		thr->count = rule->errcount;
+		thr->limit = rule->errwindow;
+		thr->rule = idx;
+
+		while (cap <= rule->errcount) {
+			cap <<= 1;
+		}
+		if (cap > batapp_rules_errcap[rule->errclass]) {
+			batapp_rules_errcap[rule->errclass] = cap;
+		}
+	}
+}
+
+/**
+  * This function orders held thresholds, shortest first
+  * @param a first threshold
+  * @param b second threshold
+  * @return int the qsort comparison result
+  */
+static int batapp_rules_heldcmp(const void* a, const void* b) {
+	const batapp_rules_thr_t* ta = a;
+	const batapp_rules_thr_t* tb = b;
+
+	if (ta->limit != tb->limit) {
+		return (ta->limit < tb->limit) ? -1 : 1;
+	}
+	return (ta->rule < tb->rule) ? -1 : (ta->rule > tb->rule);
+}
+
+/**
+  * This function orders error thresholds by count, then longest window first
+  * @param a first threshold
+  * @param b second threshold
+  * @return int the qsort comparison result
+  */
+static int batapp_rules_errcmp(const void* a, const void* b) {
+	const batapp_rules_thr_t* ta = a;
+	const batapp_rules_thr_t* tb = b;
+
+	if (ta->count != tb->count) {
+		return (ta->count < tb->count) ? -1 : 1;
+	}
+	if (ta->limit != tb->limit) {
+		return (ta->limit > tb->limit) ? -1 : 1;
+	}
+	return (ta->rule < tb->rule) ? -1 : (ta->rule > tb->rule);
+}
+
+/**
+  * This function sorts the threshold arrays, so each event only compares against the next pending threshold
+  * @return void
+  */
+static void batapp_rules_sort(void) {
+	uint32_t idx;
+	int state, errclass;
+
+	for (state = 0; state < BATAPP_RULES_UNKNOWN; state++) {
+		qsort(batapp_rules_heldthr[state], batapp_rules_heldlen[state], sizeof(batapp_rules_thr_t), batapp_rules_heldcmp);
+	}
+
+	for (errclass = 0; errclass < BATAPP_RULES_ERR_MAX; errclass++) {
+		batapp_rules_thr_t* thr = batapp_rules_errthr[errclass];
+
+		qsort(thr, batapp_rules_errlen[errclass], sizeof(batapp_rules_thr_t), batapp_rules_errcmp);
+
+		/* the thresholds sharing a count form a group */
+		for (idx = 0; idx < batapp_rules_errlen[errclass]; idx++) {
+			batapp_rules_grp_t* grp = &batapp_rules_errgrp[errclass][batapp_rules_errgrps[errclass]];
+
+			if ((idx == 0) || (thr[idx].count != thr[idx - 1].count)) {
+				grp->count = thr[idx].count;
+				grp->first = idx;
+				grp->len = 0;
+				batapp_rules_errgrps[errclass]++;
+			}
+			batapp_rules_errgrp[errclass][batapp_rules_errgrps[errclass] - 1].len++;
+		}
+	}
+}
+
+/**
+  * This function loads and compiles the rule file
+  * @param rulepath path of the rule file
+  * @param alertpath path of the alert file, NULL to alert on stderr
+  * @return bool returns success/failure for the function
+  */
+bool batapp_rules_load(const char* rulepath, const char* alertpath) {
+	char line[BATAPP_RULES_LINELEN];
+	FILE* fp;
+	int lineno = 0;
+
+	if ((fp = fopen(rulepath, "r")) == NULL) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTALERT_HDR, "Failed to open rule file");
+		return false;
+	}
+
+	batapp_rules_len = 0;
+	memset(batapp_rules, 0, sizeof(batapp_rules));
+	memset(batapp_rules_table, 0, sizeof(batapp_rules_table));
+	memset(batapp_rules_heldmask, 0, sizeof(batapp_rules_heldmask));
+	memset(batapp_rules_errmask, 0, sizeof(batapp_rules_errmask));
+	memset(batapp_rules_heldlen, 0, sizeof(batapp_rules_heldlen));
+	memset(batapp_rules_errlen, 0, sizeof(batapp_rules_errlen));
+	memset(batapp_rules_errgrps, 0, sizeof(batapp_rules_errgrps));
+	memset(batapp_rules_errcap, 0, sizeof(batapp_rules_errcap));
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		batapp_rules_rule_t* rule = &batapp_rules[batapp_rules_len];
+		char* name = line + strspn(line, " \t");
+		char* colon;
+		size_t namelen;
+
+		lineno++;
+
+		/* a line longer than the buffer would be parsed in pieces, reject it */
+		if ((strchr(line, '\n') == NULL) && !feof(fp)) {
+			batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTALERT_HDR, "Rule line %d too long", lineno);
+			fclose(fp);
+			batapp_rules_len = 0;
+			return false;
+		}
+
+		/* skip blank lines and comments */
+		if ((*name == '#') || (name[strspn(name, " \t\r\n")] == '\0')) {
+			continue;
+		}
+
+		/* <name>: <condition> [and <condition>]... */
+		namelen = strcspn(name, " \t:");
+		colon = name + namelen + strspn(name + namelen, " \t");
+		if ((namelen == 0) || (namelen >= BATAPP_RULES_NAMELEN) || (*colon != ':') ||
+			(batapp_rules_len == BATAPP_RULES_MAX) || !batapp_rules_compile(rule, colon + 1)) {
+			batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTALERT_HDR, "Invalid rule at line %d", lineno);
+			fclose(fp);
+			batapp_rules_len = 0;
+			return false;
+		}
+		memcpy(rule->name, name, namelen);
+
+		batapp_rules_addtable(batapp_rules_len++);
+	}
+
+	fclose(fp);
+
+	batapp_rules_sort();
+
+	if (alertpath == NULL) {
+		batapp_rules_alertfp = stderr;
+	}
+	else if ((batapp_rules_alertfp = fopen(alertpath, "w")) == NULL) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTALERT_HDR, "Failed to open alert file");
+		batapp_rules_len = 0;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+  * This function allocates the rule evaluation state of one packet stream
+  * @return the rule state, NULL if no rules are loaded or on failure
+  */
+struct batapp_rulestate* batapp_rules_init(void) {
+	struct batapp_rulestate* state;
+	int errclass;
+
+	if ((batapp_rules_alertfp == NULL) || (batapp_rules_len == 0)) {
+		return NULL;
+	}
+
+	if ((state = calloc(1, sizeof(struct batapp_rulestate))) == NULL) {
+		return NULL;
+	}
+
+	state->state = BATAPP_RULES_UNKNOWN;
+	state->status = BATAPP_RULES_UNKNOWN;
+
+	for (errclass = 0; errclass < BATAPP_RULES_ERR_MAX; errclass++) {
+		state->errfall[errclass] = UINT64_MAX;
+		if ((batapp_rules_errcap[errclass] > 0) &&
+			((state->errts[errclass] = malloc(batapp_rules_errcap[errclass] * sizeof(uint32_t))) == NULL)) {
+			batapp_rules_exit(state);
+			return NULL;
+		}
+	}
+
+	return state;
+}
+
+/**
+  * This function records a packet error for the error conditions
+  * @param state the rule state of the packet stream
+  * @param errclass the error class
+  * @return void
+  */
+static void batapp_rules_error(struct batapp_rulestate* state, batapp_rules_err_t errclass) {
+	if (state->errts[errclass] != NULL) {
+		state->errts[errclass][state->errseen[errclass] & (batapp_rules_errcap[errclass] - 1)] = state->ts;
+		state->errseen[errclass]++;
+	}
+}
+
+/**
+  * This function sets the held conditions passed since the power state was entered
+  * @param state the rule state of the packet stream
+  * @return void
+  */
+static void batapp_rules_held(struct batapp_rulestate* state) {
+	const batapp_rules_thr_t* thr;
+	uint32_t len;
+
+	if (state->state == BATAPP_RULES_UNKNOWN) {
+		return;
+	}
+
+	thr = batapp_rules_heldthr[state->state];
+	len = batapp_rules_heldlen[state->state];
+
+	/* the held time only grows, only the next threshold needs comparing */
+	while ((state->heldnext < len) && ((state->ts - state->statets) > thr[state->heldnext].limit)) {
+		uint32_t rule = thr[state->heldnext++].rule;
+
+		state->heldok[rule / 64] |= 1ULL << (rule % 64);
+	}
+}
+
+/**
+  * This function updates the error conditions of one class after an error or once one may stop holding
+  * @param state the rule state of the packet stream
+  * @param errclass the error class
+  * @return void
+  */
+static void batapp_rules_errors(struct batapp_rulestate* state, batapp_rules_err_t errclass) {
+	uint64_t seen = state->errseen[errclass];
+	uint32_t grpidx;
+
+	state->errfall[errclass] = UINT64_MAX;
+
+	for (grpidx = 0; grpidx < batapp_rules_errgrps[errclass]; grpidx++) {
+		const batapp_rules_grp_t* grp = &batapp_rules_errgrp[errclass][grpidx];
+		const batapp_rules_thr_t* thr = &batapp_rules_errthr[errclass][grp->first];
+		uint32_t next = state->errnext[errclass][grpidx];
+		bool enough = (seen > grp->count);
+		uint32_t oldest = 0;
+		uint32_t gap = 0;
+
+		/* more than count errors if the count + 1th latest one is within the window */
+		if (enough) {
+			oldest = state->errts[errclass][(seen - grp->count - 1) & (batapp_rules_errcap[errclass] - 1)];
+			gap = state->ts - oldest;
+		}
+
+		/* windows are longest first, the thresholds holding are a prefix of the group */
+		while (enough && (next < grp->len) && (thr[next].limit >= gap)) {
+			state->errok[thr[next].rule / 64] |= 1ULL << (thr[next].rule % 64);
+			next++;
+		}
+		while ((next > 0) && (!enough || (thr[next - 1].limit < gap))) {
+			next--;
+			state->errok[thr[next].rule / 64] &= ~(1ULL << (thr[next].rule % 64));
+		}
+		state->errnext[errclass][grpidx] = next;
+
+		/* the shortest window holding is the first to stop holding */
+		if ((next > 0) && (((uint64_t)oldest + thr[next - 1].limit) < state->errfall[errclass])) {
+			state->errfall[errclass] = (uint64_t)oldest + thr[next - 1].limit;
+		}
+	}
+}
+
+/**
+  * This function evaluates the rules after one event and alerts the rules starting to match
+  * @param state the rule state of the packet stream
+  * @param stream packet stream the event belongs to
+  * @param event the event
+  * @return void
+  */
+void batapp_rules_eval(struct batapp_rulestate* state, uint32_t stream, const batapp_pktevent_t* event) {
+	const uint64_t* cand;
+	int errclass;
+	int word;
+
+	if (state == NULL) {
+		return;
+	}
+
+	/* a failed packet error check leaves the time stamp untrustworthy */
+	if (!((event->kind == BATAPP_PKTEVENT_ERROR) && (event->val == BATAPP_PKTEVENT_ERR_CHECKSUM)) &&
+		(event->ts > state->ts)) {
+		state->ts = event->ts;
+	}
+
+	switch (event->kind) {
+	case BATAPP_PKTEVENT_POWER:
+	case BATAPP_PKTEVENT_SAMPLE:
+		if ((event->val < BATAPP_RULES_UNKNOWN) && (event->val != state->state)) {
+			state->state = event->val;
+			state->statets = event->ts;
+			/* the held conditions start over in the new state */
+			state->heldnext = 0;
+			memset(state->heldok, 0, sizeof(state->heldok));
+		}
+		break;
+	case BATAPP_PKTEVENT_STATUS:
+		if (event->val < BATAPP_RULES_UNKNOWN) {
+			state->status = event->val;
+		}
+		break;
+	case BATAPP_PKTEVENT_ERROR:
+		batapp_rules_error(state, BATAPP_RULES_ERR_ALL);
+		batapp_rules_errors(state, BATAPP_RULES_ERR_ALL);
+		if (event->val == BATAPP_PKTEVENT_ERR_CHECKSUM) {
+			batapp_rules_error(state, BATAPP_RULES_ERR_CHECKSUM);
+			batapp_rules_errors(state, BATAPP_RULES_ERR_CHECKSUM);
+		}
+		break;
+	default:
+		return;
+	}
+
+	batapp_rules_held(state);
+
+	/* error conditions only start holding on an error, and only stop once the earliest window passed */
+	for (errclass = 0; errclass < BATAPP_RULES_ERR_MAX; errclass++) {
+		if (state->ts > state->errfall[errclass]) {
+			batapp_rules_errors(state, (batapp_rules_err_t)errclass);
+		}
+	}
+
+	/* the decision table gives the rules whose state and status conditions hold */
+	cand = batapp_rules_table[state->state][state->status];
+
+	for (word = 0; word < BATAPP_RULES_WORDS; word++) {
+		uint64_t match = cand[word] &
+			(~batapp_rules_heldmask[word] | state->heldok[word]) &
+			(~batapp_rules_errmask[word] | state->errok[word]);
+		uint64_t fire;
+
+		/* alert once per rule when it starts matching */
+		fire = match & ~state->active[word];
+		state->active[word] = match;
+
+		while (fire != 0) {
+			int bit = batapp_ctz64(fire);
+
+			fire &= fire - 1;
+			batapp_flog(batapp_rules_alertfp, BATAPP_LOGGER_LEVEL_INFO, BATAPP_PKTALERT_HDR, "%u;%u;%s",
+				stream, state->ts, batapp_rules[word * 64 + bit].name);
+		}
+	}
+}
+
+/**
+  * This function frees the rule evaluation state of one packet stream
+  * @param state the rule state
+  * @return void
+  */
+void batapp_rules_exit(struct batapp_rulestate* state) {
+	int errclass;
+
+	if (state != NULL) {
+		for (errclass = 0; errclass < BATAPP_RULES_ERR_MAX; errclass++) {
+			free(state->errts[errclass]);
+		}
+		free(state);
+	}
+}
+
+/**
+  * This function unloads the rules and closes the alert file
+  * @return void
+  */
+void batapp_rules_unload(void) {
+	if ((batapp_rules_alertfp != NULL) && (batapp_rules_alertfp != stderr)) {
+		fclose(batapp_rules_alertfp);
+	}
+	batapp_rules_alertfp = NULL;
+	batapp_rules_len = 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_rules.h
+  * @brief Alert Rule Engine Interface
+  * @author Subhasish Ghosh
+  *
+  * Alert rules are loaded from a file, one rule per line:
+  *
+  *   <name>: <condition> [and <condition>]...
+  *
+  * with the conditions:
+  *
+  *   state == N | state != N        debounced power state
+  *   status == L | status != L      last battery status level, VLOW, LOW, MED, HIGH or 0-3
+  *   held > MS                      power state held for more than MS
+  *   errors > N per MS              more than N packet errors within MS
+  *   checksum > N per MS            more than N packet error check failures within MS
+  *
+  * Lines starting with # are comments. The state and status conditions
+  * are compiled into a decision table indexed by the current state and
+  * status, which yields the candidate rules of every event at once. The
+  * held times are compiled into a sorted array per state and the error
+  * counts into groups of windows sorted per class, so an event compares
+  * against the next pending threshold only. A rule alerts once each time
+  * it starts matching.
+  */
+
+#ifndef BATAPP_RULES_H
+#define BATAPP_RULES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "batapp_pkttypes.h"
+
+/* The maximum number of rules */
+#define BATAPP_RULES_MAX		256
+/* The maximum rule name length, including the terminator */
+#define BATAPP_RULES_NAMELEN	32
+/* The maximum error count of an error condition */
+#define BATAPP_RULES_MAXERRORS	1024
+
+/* The rule evaluation state of one packet stream, sized by the loaded rules */
+struct batapp_rulestate;
+
+/**
+  * This function loads and compiles the rule file
+  * @param rulepath path of the rule file
+  * @param alertpath path of the alert file, NULL to alert on stderr
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_rules_load(const char* rulepath, const char* alertpath);
+
+/**
+  * This function allocates the rule evaluation state of one packet stream
+  * @return the rule state, NULL if no rules are loaded or on failure
+  */
+extern struct batapp_rulestate* batapp_rules_init(void);
+
+/**
+  * This function evaluates the rules after one event and alerts the rules starting to match
+  * @param state the rule state of the packet stream
+  * @param stream packet stream the event belongs to
+  * @param event the event
+  * @return void
+  */
+extern void batapp_rules_eval(struct batapp_rulestate* state, uint32_t stream, const batapp_pktevent_t* event);
+
+/**
+  * This function frees the rule evaluation state of one packet stream
+  * @param state the rule state
+  * @return void
+  */
+extern void batapp_rules_exit(struct batapp_rulestate* state);
+
+/**
+  * This function unloads the rules and closes the alert file
+  * @return void
+  */
+extern void batapp_rules_unload(void);
+
+#endif //BATAPP_RULES_H
\ No newline at end of file
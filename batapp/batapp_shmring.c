@@ -0,0 +1,493 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_shmring.c
+  * @brief Shared Memory Event Ring Writer and Reader
+  * @author Subhasish Ghosh
+  */
+
+#include <stdio.h>
+#include "batapp_logger.h"
+#include "batapp_pkttypes.h"
+#include "batapp_shmring.h"
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/* number of polls of the ring head before a reader goes to sleep */
+#define BATAPP_SHMRING_SPINS	1000
+/* interval in ns at which a reader checks for the ring to be initialised */
+#define BATAPP_SHMRING_POLLNS	1000000L
+
+/* the shared memory object name, removed again when the writer closes the ring */
+static const char* batapp_shmring_name = NULL;
+/* the writer mapping, NULL if the ring is not open */
+static batapp_shmring_hdr_t* batapp_shmring_hdr = NULL;
+static batapp_shmring_slot_t* batapp_shmring_slot = NULL;
+/* serialises publishing when several daemon workers share the single writer */
+static pthread_mutex_t batapp_shmring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+  * This function returns the size of the shared memory object
+  * @return size_t the size in bytes
+  */
+static size_t batapp_shmring_size(void) {
+	return sizeof(batapp_shmring_hdr_t) + BATAPP_SHMRING_SLOTS * sizeof(batapp_shmring_slot_t);
+}
+
+/**
+  * This function wraps the futex system call
+  * @param addr futex word
+  * @param op FUTEX_WAIT or FUTEX_WAKE
+  * @param val expected value for FUTEX_WAIT, number of waiters for FUTEX_WAKE
+  * @param timeout_ms the maximum time to sleep, -1 to wait forever
+  * @return long the system call result
+  */
+static long batapp_shmring_futex(uint32_t* addr, int op, uint32_t val, int timeout_ms) {
+	struct timespec ts;
+
+	if (timeout_ms < 0) {
+		return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+	}
+
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+	return syscall(SYS_futex, addr, op, val, &ts, NULL, 0);
+}
+
+/**
+  * This function wakes all sleeping readers
+  * @param hdr ring header
+  * @return void
+  */
+static void batapp_shmring_wake(batapp_shmring_hdr_t* hdr) {
+	__atomic_add_fetch(&hdr->futex, 1, __ATOMIC_SEQ_CST);
+	batapp_shmring_futex(&hdr->futex, FUTEX_WAKE, INT_MAX, -1);
+}
+
+/**
+  * This function creates the shared memory ring and starts publishing events into it
+  * @param name POSIX shared memory object name, e.g. /batapp
+  * @return bool returns success/failure for the function
+  */
+bool batapp_shmring_open(const char* name) {
+	size_t size = batapp_shmring_size();
+	batapp_shmring_hdr_t* hdr;
+	int fd;
+
+	if ((fd = shm_open(name, O_CREAT | O_RDWR, 0644)) < 0) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTEVENT_HDR, "Failed to open shared memory %s", name);
+		return false;
+	}
+
+	if (ftruncate(fd, (off_t)size) < 0) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTEVENT_HDR, "Failed to size shared memory %s", name);
+		close(fd);
+		shm_unlink(name);
+		return false;
+	}
+
+	hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (hdr == MAP_FAILED) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTEVENT_HDR, "Failed to map shared memory %s", name);
+		shm_unlink(name);
+		return false;
+	}
+
+	/* the writer owns the ring, start it afresh */
+	memset(hdr, 0, size);
+	hdr->version = BATAPP_SHMRING_VERSION;
+	hdr->slots = BATAPP_SHMRING_SLOTS;
+	hdr->slotsize = sizeof(batapp_shmring_slot_t);
+	/* readers check the magic, so it goes in last */
+	__atomic_store_n(&hdr->magic, BATAPP_SHMRING_MAGIC, __ATOMIC_RELEASE);
+
+	batapp_shmring_slot = (batapp_shmring_slot_t*)(hdr + 1);
+	batapp_shmring_hdr = hdr;
+	batapp_shmring_name = name;
+	return true;
+}
+
+/**
+  * This function publishes one event, it does nothing if the ring is not open
+  * @param stream packet stream the event belongs to
+  * @param event the event to publish
+  * @return void
+  */
+void batapp_shmring_publish(uint32_t stream, const batapp_pktevent_t* event) {
+	batapp_shmring_hdr_t* hdr = batapp_shmring_hdr;
+	batapp_shmring_slot_t* slot;
+	uint64_t seq;
+
+	if (hdr == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&batapp_shmring_lock);
+
+	seq = hdr->head;
+	slot = &batapp_shmring_slot[seq & (BATAPP_SHMRING_SLOTS - 1)];
+
+	/* mark the slot as being written before overwriting it */
+	__atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot->stream = stream;
+	slot->event = *event;
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELEASE);
+
+	/* publish, then wake the readers only if any is sleeping */
+	__atomic_store_n(&hdr->head, seq + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&hdr->waiters, __ATOMIC_SEQ_CST) != 0) {
+		batapp_shmring_wake(hdr);
+	}
+
+	pthread_mutex_unlock(&batapp_shmring_lock);
+}
+
+/**
+  * This function marks the ring closed for the readers, unmaps and removes it
+  * @return void
+  */
+void batapp_shmring_close(void) {
+	batapp_shmring_hdr_t* hdr = batapp_shmring_hdr;
+
+	if (hdr == NULL) {
+		return;
+	}
+
+	batapp_shmring_hdr = NULL;
+	__atomic_store_n(&hdr->closed, 1, __ATOMIC_SEQ_CST);
+	batapp_shmring_wake(hdr);
+	munmap(hdr, batapp_shmring_size());
+
+	/* readers still attached keep their mapping until they close */
+	shm_unlink(batapp_shmring_name);
+	batapp_shmring_name = NULL;
+}
+
+/**
+  * This function maps an opened ring and attaches a reader to it
+  * @param reader the reader to init
+  * @param fd shared memory file descriptor, closed by this function
+  * @param name POSIX shared memory object name
+  * @param fromstart start at the oldest event still held instead of the next new event
+  * @return bool returns success/failure for the function
+  */
+static bool batapp_shmreader_attach(batapp_shmreader_t* reader, int fd, const char* name, bool fromstart) {
+	struct stat st;
+	uint64_t head;
+
+	memset(reader, 0, sizeof(*reader));
+
+	if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(batapp_shmring_hdr_t))) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTEVENT_HDR, "Invalid shared memory %s", name);
+		close(fd);
+		return false;
+	}
+
+	reader->maplen = (size_t)st.st_size;
+	reader->hdr = mmap(NULL, reader->maplen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (reader->hdr == MAP_FAILED) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTEVENT_HDR, "Failed to map shared memory %s", name);
+		reader->hdr = NULL;
+		return false;
+	}
+
+	if ((__atomic_load_n(&reader->hdr->magic, __ATOMIC_ACQUIRE) != BATAPP_SHMRING_MAGIC) ||
+		(reader->hdr->version != BATAPP_SHMRING_VERSION) ||
+		(reader->hdr->slotsize != sizeof(batapp_shmring_slot_t)) ||
+		(reader->hdr->slots & (reader->hdr->slots - 1)) ||
+		(reader->maplen < sizeof(batapp_shmring_hdr_t) + (size_t)reader->hdr->slots * sizeof(batapp_shmring_slot_t))) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTEVENT_HDR, "Invalid shared memory %s", name);
+		batapp_shmreader_close(reader);
+		return false;
+	}
+
+	reader->slot = (batapp_shmring_slot_t*)(reader->hdr + 1);
+
+	head = __atomic_load_n(&reader->hdr->head, __ATOMIC_ACQUIRE);
+	if (!fromstart) {
+		reader->cursor = head;
+	}
+	else if (head > reader->hdr->slots) {
+		reader->cursor = head - reader->hdr->slots;
+	}
+
+	return true;
+}
+
+/**
+  * This function attaches a reader to the shared memory ring
+  * @param reader the reader to init
+  * @param name POSIX shared memory object name
+  * @param fromstart start at the oldest event still held instead of the next new event
+  * @return bool returns success/failure for the function
+  */
+bool batapp_shmreader_open(batapp_shmreader_t* reader, const char* name, bool fromstart) {
+	int fd;
+
+	/* readers need write access for the sleep/wake handshake */
+	if ((fd = shm_open(name, O_RDWR, 0)) < 0) {
+		memset(reader, 0, sizeof(*reader));
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTEVENT_HDR, "Failed to open shared memory %s", name);
+		return false;
+	}
+
+	return batapp_shmreader_attach(reader, fd, name, fromstart);
+}
+
+/**
+  * This function returns the next event in place, without copying it
+  * @param reader the reader
+  * @return the slot of the next event, NULL if none is available yet
+  */
+const batapp_shmring_slot_t* batapp_shmreader_peek(batapp_shmreader_t* reader) {
+	uint64_t slots = reader->hdr->slots;
+
+	for (;;) {
+		uint64_t head = __atomic_load_n(&reader->hdr->head, __ATOMIC_ACQUIRE);
+		batapp_shmring_slot_t* slot;
+
+		if (reader->cursor >= head) {
+			return NULL;
+		}
+
+		/* the writer lapped this reader, skip to the oldest event still held */
+		if ((head - reader->cursor) > slots) {
+			reader->lost += head - slots - reader->cursor;
+			reader->cursor = head - slots;
+		}
+
+		slot = &reader->slot[reader->cursor & (slots - 1)];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == (reader->cursor + 1)) {
+			return slot;
+		}
+
+		/* the slot is already being reused */
+		reader->lost++;
+		reader->cursor++;
+	}
+}
+
+/**
+  * This function releases the event returned by batapp_shmreader_peek and moves to the next one
+  * @param reader the reader
+  * @return bool returns false if the event was overwritten while in use, it must then be discarded
+  */
+bool batapp_shmreader_release(batapp_shmreader_t* reader) {
+	batapp_shmring_slot_t* slot = &reader->slot[reader->cursor & (reader->hdr->slots - 1)];
+	uint64_t seq;
+
+	/* the event reads must complete before the sequence is checked again */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+	reader->cursor++;
+	if (seq != reader->cursor) {
+		reader->lost++;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+  * This function sleeps until an event is available or the writer closed the ring
+  * @param reader the reader
+  * @param timeout_ms the maximum time to sleep, -1 to wait forever
+  * @return bool returns false if the ring is closed and fully read
+  */
+bool batapp_shmreader_wait(batapp_shmreader_t* reader, int timeout_ms) {
+	batapp_shmring_hdr_t* hdr = reader->hdr;
+	uint32_t futexval;
+	int spin;
+
+	/* events usually follow each other closely, poll a little before sleeping */
+	for (spin = 0; spin < BATAPP_SHMRING_SPINS; spin++) {
+		if (__atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE) > reader->cursor) {
+			return true;
+		}
+	}
+
+	/*
+	 * announce the sleep before checking the head again, the writer
+	 * stores the head before checking for waiters, so either it sees
+	 * this reader waiting or this reader sees the new head
+	 */
+	__atomic_add_fetch(&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+	futexval = __atomic_load_n(&hdr->futex, __ATOMIC_SEQ_CST);
+	if ((__atomic_load_n(&hdr->head, __ATOMIC_SEQ_CST) <= reader->cursor) &&
+		!__atomic_load_n(&hdr->closed, __ATOMIC_SEQ_CST)) {
+		batapp_shmring_futex(&hdr->futex, FUTEX_WAIT, futexval, timeout_ms);
+	}
+	__atomic_sub_fetch(&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+
+	return !(__atomic_load_n(&hdr->closed, __ATOMIC_SEQ_CST) &&
+		(__atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE) <= reader->cursor));
+}
+
+/**
+  * This function detaches a reader from the shared memory ring
+  * @param reader the reader
+  * @return void
+  */
+void batapp_shmreader_close(batapp_shmreader_t* reader) {
+	if (reader->hdr != NULL) {
+		munmap(reader->hdr, reader->maplen);
+		reader->hdr = NULL;
+		reader->slot = NULL;
+	}
+}
+
+/**
+  * This function waits until a writer has initialised the ring
+  * @param fd shared memory file descriptor
+  * @return bool returns success/failure for the function
+  */
+static bool batapp_shmreader_ready(int fd) {
+	struct timespec ts = { 0, BATAPP_SHMRING_POLLNS };
+	batapp_shmring_hdr_t* hdr;
+
+	hdr = mmap(NULL, sizeof(batapp_shmring_hdr_t), PROT_READ, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED) {
+		return false;
+	}
+
+	while (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != BATAPP_SHMRING_MAGIC) {
+		nanosleep(&ts, NULL);
+	}
+
+	munmap(hdr, sizeof(batapp_shmring_hdr_t));
+	return true;
+}
+
+/**
+  * This function waits for a writer to create the shared memory ring, then prints its events until the writer closes it
+  * @param name POSIX shared memory object name
+  * @return bool returns success/failure for the function
+  */
+bool batapp_shmreader_run(const char* name) {
+	batapp_shmreader_t reader;
+	struct stat st;
+	int fd;
+
+	/*
+	 * create the object if no writer did yet, the writer then reuses it,
+	 * and holding it open keeps it alive once the writer removes it
+	 */
+	if ((fd = shm_open(name, O_CREAT | O_RDWR, 0644)) < 0) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTEVENT_HDR, "Failed to open shared memory %s", name);
+		return false;
+	}
+
+	if ((fstat(fd, &st) < 0) ||
+		(((size_t)st.st_size < batapp_shmring_size()) && (ftruncate(fd, (off_t)batapp_shmring_size()) < 0)) ||
+		!batapp_shmreader_ready(fd)) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTEVENT_HDR, "Failed to map shared memory %s", name);
+		close(fd);
+		return false;
+	}
+
+	if (!batapp_shmreader_attach(&reader, fd, name, true)) {
+		return false;
+	}
+
+	for (;;) {
+		const batapp_shmring_slot_t* slot = batapp_shmreader_peek(&reader);
+		batapp_pktevent_t event;
+		uint32_t stream;
+
+		if (slot == NULL) {
+			if (!batapp_shmreader_wait(&reader, -1)) {
+				break;
+			}
+			continue;
+		}
+
+		/* take what is needed from the slot, then check it was not overwritten meanwhile */
+		stream = slot->stream;
+		event = slot->event;
+		if (batapp_shmreader_release(&reader)) {
+			batapp_log(BATAPP_LOGGER_LEVEL_INFO, BATAPP_PKTEVENT_HDR, "%u;%u;%u;%u;%u;%u;%u",
+				stream, event.ts, event.kind, event.pkttype, event.prev, event.val, event.next);
+		}
+	}
+
+	if (reader.lost > 0) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTEVENT_HDR, "lost %llu events", (unsigned long long)reader.lost);
+	}
+
+	batapp_shmreader_close(&reader);
+	return true;
+}
+
+#else
+
+/* the shared memory ring is built upon POSIX shared memory and futexes */
+static const char* batapp_shmring_unsupported = "Shared memory ring is only supported on linux";
+
+bool batapp_shmring_open(const char* name) {
+	(void)name;
+	batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTEVENT_HDR, batapp_shmring_unsupported);
+	return false;
+}
+
+void batapp_shmring_publish(uint32_t stream, const batapp_pktevent_t* event) {
+	(void)stream;
+	(void)event;
+}
+
+void batapp_shmring_close(void) {
+}
+
+bool batapp_shmreader_open(batapp_shmreader_t* reader, const char* name, bool fromstart) {
+	(void)reader;
+	(void)name;
+	(void)fromstart;
+	batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTEVENT_HDR, batapp_shmring_unsupported);
+	return false;
+}
+
+const batapp_shmring_slot_t* batapp_shmreader_peek(batapp_shmreader_t* reader) {
+	(void)reader;
+	return NULL;
+}
+
+bool batapp_shmreader_release(batapp_shmreader_t* reader) {
+	(void)reader;
+	return false;
+}
+
+bool batapp_shmreader_wait(batapp_shmreader_t* reader, int timeout_ms) {
+	(void)reader;
+	(void)timeout_ms;
+	return false;
+}
+
+void batapp_shmreader_close(batapp_shmreader_t* reader) {
+	(void)reader;
+}
+
+bool batapp_shmreader_run(const char* name) {
+	(void)name;
+	batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTEVENT_HDR, batapp_shmring_unsupported);
+	return false;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_shmring.h
+  * @brief Shared Memory Event Ring Interface
+  * @author Subhasish Ghosh
+  *
+  * batapp publishes its binary events into a POSIX shared memory ring
+  * with a single writer. Any number of readers attach to the ring, each
+  * keeping its own cursor. Readers access the events in place and only
+  * enter the kernel (futex) when the ring is empty.
+  *
+  * The writer never waits for readers. A reader falling more than the
+  * ring capacity behind skips the overwritten events and is told how
+  * many were lost.
+  *
+  * The writer creates the shared memory object when it opens the ring and
+  * removes it when it closes the ring. Readers attached by then keep their
+  * mapping and see the ring closed; new readers must attach while the
+  * writer runs.
+  */
+
+#ifndef BATAPP_SHMRING_H
+#define BATAPP_SHMRING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "batapp_pkttypes.h"
+
+/* shared memory ring magic "BSHM" and layout version */
+#define BATAPP_SHMRING_MAGIC	0x4D485342UL
+#define BATAPP_SHMRING_VERSION	2
+/* number of event slots, must be a power of 2 */
+#define BATAPP_SHMRING_SLOTS	(1UL << 16)
+
+/* shared memory ring header, followed by the slots */
+typedef struct {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	slots;		/* number of slots */
+	uint32_t	slotsize;	/* sizeof(batapp_shmring_slot_t) */
+	uint32_t	closed;		/* set once the writer is done */
+	uint32_t	rsvd;
+	uint64_t	head;		/* sequence number of the next event to publish */
+	uint32_t	futex;		/* bumped to wake sleeping readers */
+	uint32_t	waiters;	/* number of sleeping readers */
+	uint8_t		pad[24];	/* keeps the slots cache line aligned */
+} batapp_shmring_hdr_t;
+
+/* one event slot */
+typedef struct {
+	uint64_t			seq;	/* sequence number + 1 of the event held, 0 while being written */
+	uint32_t			stream;	/* packet stream, the daemon connection id or 0 for a data file */
+	batapp_pktevent_t	event;	/* event.next holds the to state of an invalid transition error */
+} batapp_shmring_slot_t;
+
+/* This struct stores the state of one reader */
+typedef struct {
+	batapp_shmring_hdr_t*	hdr;
+	batapp_shmring_slot_t*	slot;	/* first slot of the ring */
+	size_t					maplen;
+	uint64_t				cursor;	/* sequence number of the next event to read */
+	uint64_t				lost;	/* events overwritten before they were read */
+} batapp_shmreader_t;
+
+/**
+  * This function creates the shared memory ring and starts publishing events into it
+  * @param name POSIX shared memory object name, e.g. /batapp
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_shmring_open(const char* name);
+
+/**
+  * This function publishes one event, it does nothing if the ring is not open
+  * @param stream packet stream the event belongs to
+  * @param event the event to publish
+  * @return void
+  */
+extern void batapp_shmring_publish(uint32_t stream, const batapp_pktevent_t* event);
+
+/**
+  * This function marks the ring closed for the readers, unmaps and removes it
+  * @return void
+  */
+extern void batapp_shmring_close(void);
+
+/**
+  * This function attaches a reader to the shared memory ring
+  * @param reader the reader to init
+  * @param name POSIX shared memory object name
+  * @param fromstart start at the oldest event still held instead of the next new event
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_shmreader_open(batapp_shmreader_t* reader, const char* name, bool fromstart);
+
+/**
+  * This function returns the next event in place, without copying it
+  * @param reader the reader
+  * @return the slot of the next event, NULL if none is available yet
+  */
+extern const batapp_shmring_slot_t* batapp_shmreader_peek(batapp_shmreader_t* reader);
+
+/**
+  * This function releases the event returned by batapp_shmreader_peek and moves to the next one
+  * @param reader the reader
+  * @return bool returns false if the event was overwritten while in use, it must then be discarded
+  */
+extern bool batapp_shmreader_release(batapp_shmreader_t* reader);
+
+/**
+  * This function sleeps until an event is available or the writer closed the ring
+  * @param reader the reader
+  * @param timeout_ms the maximum time to sleep, -1 to wait forever
+  * @return bool returns false if the ring is closed and fully read
+  */
+extern bool batapp_shmreader_wait(batapp_shmreader_t* reader, int timeout_ms);
+
+/**
+  * This function detaches a reader from the shared memory ring
+  * @param reader the reader
+  * @return void
+  */
+extern void batapp_shmreader_close(batapp_shmreader_t* reader);
+
+/**
+  * This function waits for a writer to create the shared memory ring, then prints its events until the writer closes it
+  * @param name POSIX shared memory object name
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_shmreader_run(const char* name);
+
+#endif //BATAPP_SHMRING_H
\ No newline at end of file
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_trace.c
+  * @brief Hot-path Trace Point Recorder and Chrome Trace Exporter
+  * @author Subhasish Ghosh
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "batapp_logger.h"
+#include "batapp_pkttypes.h"
+#include "batapp_pktutils.h"
+#include "batapp_trace.h"
+
+/* trace names as shown in chrome/perfetto, the order should match batapp_trace_id_t */
+static const char* batapp_trace_names[BATAPP_TRACE_ID_MAX] = {
+	"parser_read",
+	"pkt_step",
+	"pkt_read",
+	"pkt_checksum",
+	"pkt_classify",
+	"pkt_transition",
+	"log_flush",
+	"daemon_batch",
+};
+
+/* chrome trace phase characters, the order should match batapp_trace_ph_t */
+static const char batapp_trace_phases[] = { 'B', 'E', 'i' };
+
+#if defined(BATAPP_TRACE)
+/* the trace file path, NULL if tracing was not requested */
+static const char* batapp_trace_path = NULL;
+/* reference ns when the trace file was opened */
+static uint64_t batapp_trace_epoch = 0;
+/* the calling thread's ring, NULL if the thread is not tracing */
+batapp_tls batapp_trace_ring_t* batapp_trace_ring = NULL;
+#endif
+
+/**
+  * This function returns the reference monotonic clock in ns
+  * @return uint64_t current time in ns
+  */
+uint64_t batapp_trace_refns(void) {
+#ifdef __GNUC__
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#else
+	LARGE_INTEGER freq, now;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#endif
+}
+
+/**
+  * This function is used to open (truncate) the trace file
+  * @param tracepath path of the binary trace file
+  * @return bool returns success/failure for the function
+  */
+bool batapp_trace_open(const char* tracepath) {
+#if defined(BATAPP_TRACE)
+	FILE* fp;
+
+	/* truncate any previous trace, threads append to it on stop */
+	if ((fp = fopen(tracepath, "wb")) == NULL) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTTRACE_HDR, "Failed to open trace file");
+		return false;
+	}
+	fclose(fp);
+
+	batapp_trace_path = tracepath;
+	batapp_trace_epoch = batapp_trace_refns();
+	return true;
+#else
+	(void)tracepath;
+	batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTTRACE_HDR, "Tracing not compiled in, rebuild with BATAPP_TRACE");
+	return false;
+#endif
+}
+
+/**
+  * This function starts tracing on the calling thread
+  * @param tid thread id to tag the records with
+  * @return bool returns success/failure for the function
+  */
+bool batapp_trace_thread_start(uint16_t tid) {
+#if defined(BATAPP_TRACE)
+	batapp_trace_ring_t* ring;
+
+	/* nothing to do if tracing was not requested */
+	if ((batapp_trace_path == NULL) || (batapp_trace_ring != NULL)) {
+		return true;
+	}
+
+	if ((ring = malloc(sizeof(batapp_trace_ring_t))) == NULL) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTTRACE_HDR, "Failed to allocate trace ring");
+		return false;
+	}
+
+	ring->hdr.magic = BATAPP_TRACE_MAGIC;
+	ring->hdr.version = BATAPP_TRACE_VERSION;
+	ring->hdr.tid = tid;
+	ring->hdr.ringlen = BATAPP_TRACE_RINGLEN;
+	ring->hdr.rsvd = 0;
+	ring->hdr.head = 0;
+	ring->hdr.epoch = batapp_trace_epoch;
+	ring->hdr.ticks0 = batapp_trace_ticks();
+	ring->hdr.ns0 = batapp_trace_refns();
+
+	batapp_trace_ring = ring;
+#else
+	(void)tid;
+#endif
+	return true;
+}
+
+/**
+  * This function stops tracing on the calling thread and appends its ring to the trace file
+  * @return void
+  */
+void batapp_trace_thread_stop(void) {
+#if defined(BATAPP_TRACE)
+	batapp_trace_ring_t* ring = batapp_trace_ring;
+	FILE* fp;
+
+	if (ring == NULL) {
+		return;
+	}
+	batapp_trace_ring = NULL;
+
+	ring->hdr.ticks1 = batapp_trace_ticks();
+	ring->hdr.ns1 = batapp_trace_refns();
+
+	/*
+	 * unbuffered append so the whole chunk goes out in a single write,
+	 * this keeps chunks from concurrently stopping threads apart
+	 */
+	if ((fp = fopen(batapp_trace_path, "ab")) != NULL) {
+		setvbuf(fp, NULL, _IONBF, 0);
+		if (fwrite(ring, sizeof(batapp_trace_ring_t), 1, fp) != 1) {
+			batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTTRACE_HDR, "Failed to write trace file");
+		}
+		fclose(fp);
+	}
+	else {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTTRACE_HDR, "Failed to open trace file");
+	}
+
+	free(ring);
+#endif
+}
+
+/**
+  * This function converts a binary trace file into chrome/perfetto json
+  * @param tracepath path of the binary trace file
+  * @param jsonpath path of the json file to write
+  * @return bool returns success/failure for the function
+  */
+bool batapp_trace_dump(const char* tracepath, const char* jsonpath) {
+	FILE* fp;
+	FILE* out;
+	batapp_trace_hdr_t hdr;
+	batapp_trace_rec_t* rec;
+	bool retval = false;
+	bool first = true;
+
+	if ((fp = fopen(tracepath, "rb")) == NULL) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTTRACE_HDR, "Failed to open trace file");
+		return retval;
+	}
+
+	if ((out = fopen(jsonpath, "w")) == NULL) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTTRACE_HDR, "Failed to open json file");
+		fclose(fp);
+		return retval;
+	}
+
+	if ((rec = malloc(BATAPP_TRACE_RINGLEN * sizeof(batapp_trace_rec_t))) == NULL) {
+		batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTTRACE_HDR, "Failed to allocate trace ring");
+		goto exit_dump;
+	}
+
+	retval = true;
+	fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+	/* the trace file is a sequence of per thread chunks */
+	while (fread(&hdr, sizeof(hdr), 1, fp) == 1) {
+		uint64_t start, idx;
+		uint32_t depth = 0;
+		double nsperticks = 1.0;
+
+		if ((hdr.magic != BATAPP_TRACE_MAGIC) || (hdr.version != BATAPP_TRACE_VERSION) ||
+			(hdr.ringlen != BATAPP_TRACE_RINGLEN)) {
+			batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTTRACE_HDR, "Invalid trace chunk");
+			retval = false;
+			break;
+		}
+
+		if (fread(rec, sizeof(batapp_trace_rec_t), hdr.ringlen, fp) != hdr.ringlen) {
+			batapp_log(BATAPP_LOGGER_LEVEL_ERROR, BATAPP_PKTTRACE_HDR, "Truncated trace chunk");
+			retval = false;
+			break;
+		}
+
+		/* convert ticks to ns using the start/stop reference pairs */
+		if (hdr.ticks1 > hdr.ticks0) {
+			nsperticks = (double)(hdr.ns1 - hdr.ns0) / (double)(hdr.ticks1 - hdr.ticks0);
+		}
+
+		/* the ring holds only the most recent ringlen records */
+		start = (hdr.head > hdr.ringlen) ? (hdr.head - hdr.ringlen) : 0;
+
+		for (idx = start; idx < hdr.head; idx++) {
+			batapp_trace_rec_t* r = &rec[idx & (hdr.ringlen - 1)];
+			double ns = (double)hdr.ns0 - (double)hdr.epoch + ((double)r->ts - (double)hdr.ticks0) * nsperticks;
+
+			if ((r->id >= BATAPP_TRACE_ID_MAX) || (r->ph >= ARRAY_SIZE(batapp_trace_phases))) {
+				continue;
+			}
+
+			/* once the ring wrapped, the oldest ends may have lost their begins */
+			if (r->ph == BATAPP_TRACE_PH_BEGIN) {
+				depth++;
+			}
+			else if (r->ph == BATAPP_TRACE_PH_END) {
+				if (depth == 0) {
+					continue;
+				}
+				depth--;
+			}
+
+			fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"batapp\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+				first ? "" : ",", batapp_trace_names[r->id], batapp_trace_phases[r->ph], ns / 1000.0, hdr.tid);
+			if (r->ph == BATAPP_TRACE_PH_INSTANT) {
+				fprintf(out, ",\"s\":\"t\"");
+			}
+			if (r->ph != BATAPP_TRACE_PH_END) {
+				fprintf(out, ",\"args\":{\"arg\":%u}", r->arg);
+			}
+			fprintf(out, "}");
+			first = false;
+		}
+	}
+
+	fprintf(out, "\n]}\n");
+	free(rec);
+
+exit_dump:
+	fclose(out);
+	fclose(fp);
+	return retval;
+}
\ No newline at end of file
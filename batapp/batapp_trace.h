@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2021, ABC Limited. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+ /**
+  * @file batapp_trace.h
+  * @brief Hot-path Trace Point Interface
+  * @author Subhasish Ghosh
+  *
+  * Trace points are compiled in only when BATAPP_TRACE is defined. Each
+  * thread records into its own binary ring buffer, which is appended to
+  * the trace file when the thread stops tracing.
+  */
+
+#ifndef BATAPP_TRACE_H
+#define BATAPP_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "batapp_platform.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define batapp_trace_ticks()	__rdtsc()
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define batapp_trace_ticks()	__rdtsc()
+#else
+#define batapp_trace_ticks()	batapp_trace_refns()
+#endif
+
+/* trace file magic "BTRC" and format version */
+#define BATAPP_TRACE_MAGIC		0x43525442UL
+#define BATAPP_TRACE_VERSION	1
+/* number of records per thread ring, must be a power of 2 */
+#define BATAPP_TRACE_RINGLEN	(1UL << 14)
+
+/* trace point identifiers */
+typedef enum {
+	BATAPP_TRACE_PARSER_READ,	/* reading the packet header */
+	BATAPP_TRACE_PKT_STEP,		/* one packet state machine step, arg = packet type */
+	BATAPP_TRACE_PKT_READ,		/* reading the packet body */
+	BATAPP_TRACE_PKT_CHECKSUM,	/* packet error check */
+	BATAPP_TRACE_PKT_CLASSIFY,	/* power state / status level classification */
+	BATAPP_TRACE_PKT_TRANSITION,/* debounced power state change, arg = from << 8 | to */
+	BATAPP_TRACE_LOG_FLUSH,		/* writing one output line */
+	BATAPP_TRACE_DAEMON_BATCH,	/* processing one received batch, arg = bytes */
+	BATAPP_TRACE_ID_MAX
+} batapp_trace_id_t;
+
+/* trace record phases, these map to the chrome trace phases */
+typedef enum {
+	BATAPP_TRACE_PH_BEGIN,
+	BATAPP_TRACE_PH_END,
+	BATAPP_TRACE_PH_INSTANT,
+} batapp_trace_ph_t;
+
+/* one trace record */
+typedef struct {
+	uint64_t	ts;		/* raw clock ticks */
+	uint32_t	arg;	/* trace point argument */
+	uint16_t	id;		/* batapp_trace_id_t */
+	uint8_t		ph;		/* batapp_trace_ph_t */
+	uint8_t		rsvd;
+} batapp_trace_rec_t;
+
+/* per thread chunk header, as written into the trace file */
+typedef struct {
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	tid;		/* thread id given to batapp_trace_thread_start */
+	uint32_t	ringlen;	/* number of records in the ring */
+	uint32_t	rsvd;
+	uint64_t	head;		/* records written so far, the ring keeps the last ringlen */
+	uint64_t	epoch;		/* reference ns when the trace file was opened */
+	uint64_t	ticks0;		/* ticks/ns pair when the thread started tracing */
+	uint64_t	ns0;
+	uint64_t	ticks1;		/* ticks/ns pair when the thread stopped tracing */
+	uint64_t	ns1;
+} batapp_trace_hdr_t;
+
+/* per thread ring buffer, written to the file with a single fwrite */
+typedef struct {
+	batapp_trace_hdr_t	hdr;
+	batapp_trace_rec_t	rec[BATAPP_TRACE_RINGLEN];
+} batapp_trace_ring_t;
+
+/**
+  * This function returns the reference monotonic clock in ns
+  * @return uint64_t current time in ns
+  */
+extern uint64_t batapp_trace_refns(void);
+
+/**
+  * This function is used to open (truncate) the trace file
+  * @param tracepath path of the binary trace file
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_trace_open(const char* tracepath);
+
+/**
+  * This function starts tracing on the calling thread
+  * @param tid thread id to tag the records with
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_trace_thread_start(uint16_t tid);
+
+/**
+  * This function stops tracing on the calling thread and appends its ring to the trace file
+  * @return void
+  */
+extern void batapp_trace_thread_stop(void);
+
+/**
+  * This function converts a binary trace file into chrome/perfetto json
+  * @param tracepath path of the binary trace file
+  * @param jsonpath path of the json file to write
+  * @return bool returns success/failure for the function
+  */
+extern bool batapp_trace_dump(const char* tracepath, const char* jsonpath);
+
+#if defined(BATAPP_TRACE)
+
+/* the calling thread's ring, NULL if the thread is not tracing */
+extern batapp_tls batapp_trace_ring_t* batapp_trace_ring;
+
+/**
+  * This function records one trace point into the calling thread's ring
+  * @param id trace point identifier
+  * @param ph trace record phase
+  * @param arg trace point argument
+  * @return void
+  */
+static inline void batapp_trace_emit(uint16_t id, uint8_t ph, uint32_t arg) {
+	batapp_trace_ring_t* ring = batapp_trace_ring;
+
+	if (ring != NULL) {
+		batapp_trace_rec_t* rec = &ring->rec[ring->hdr.head++ & (BATAPP_TRACE_RINGLEN - 1)];
+		rec->ts = batapp_trace_ticks();
+		rec->arg = arg;
+		rec->id = id;
+		rec->ph = ph;
+		rec->rsvd = 0;
+	}
+}
+
+#define BATAPP_TRACE_BEGIN(id, arg)	batapp_trace_emit((id), BATAPP_TRACE_PH_BEGIN, (uint32_t)(arg))
+#define BATAPP_TRACE_END(id)		batapp_trace_emit((id), BATAPP_TRACE_PH_END, 0)
+#define BATAPP_TRACE_MARK(id, arg)	batapp_trace_emit((id), BATAPP_TRACE_PH_INSTANT, (uint32_t)(arg))
+
+#else
+
+/* trace points compile out completely */
+#define BATAPP_TRACE_BEGIN(id, arg)	((void)0)
+#define BATAPP_TRACE_END(id)		((void)0)
+#define BATAPP_TRACE_MARK(id, arg)	((void)0)
+
+#endif
+
+#endif //BATAPP_TRACE_H
\ No newline at end of file